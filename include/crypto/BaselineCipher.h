@@ -0,0 +1,26 @@
+#pragma once
+#include "ICipherStrategy.h"
+#include "../provider/IProviderLoader.h"
+#include <openssl/provider.h>
+#include <string>
+#include <vector>
+
+namespace tls {
+
+    // TLS 1.3 with the standard AES-GCM / ChaCha20 suites from the default
+    // provider. Used as a reference point against GostCipher.
+    class BaselineCipher : public ICipherStrategy {
+    public:
+        explicit BaselineCipher(IProviderLoader* loader, const std::string& algorithm = "baseline");
+        ~BaselineCipher() override;
+
+        bool configureContext(SSL_CTX* ctx) override;
+        static std::vector<std::string> supportedSuites();
+
+    private:
+        IProviderLoader* _loader;
+        OSSL_PROVIDER* _default = nullptr;
+        std::string _algorithm;
+    };
+
+}
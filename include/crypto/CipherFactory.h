@@ -0,0 +1,16 @@
+#pragma once
+#include "ICipherStrategy.h"
+#include "../provider/IProviderLoader.h"
+#include <memory>
+#include <string>
+
+namespace tls {
+
+    // --cipher value -> strategy:
+    //   "null"                             -> NullCipher (plaintext, test only)
+    //   "baseline" | TLS_AES_* | TLS_CHACHA20_* -> BaselineCipher
+    //   anything else ("any", TLS_GOSTR*)  -> GostCipher
+    std::unique_ptr<ICipherStrategy> makeCipherStrategy(IProviderLoader* loader,
+                                                        const std::string& algorithm);
+
+}
@@ -7,6 +7,8 @@ class ICipherStrategy {
 public:
     virtual ~ICipherStrategy() = default; 
     virtual bool configureContext(SSL_CTX* ctx) = 0;
+    // false -> framing runs directly over the TCP socket, no handshake
+    virtual bool usesTls() const { return true; }
 };
 
-}
\ No newline at end of file
+}
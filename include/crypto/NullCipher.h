@@ -0,0 +1,14 @@
+#pragma once
+#include "ICipherStrategy.h"
+
+namespace tls {
+
+    // Test only: no TLS at all, frames go over the TCP socket in plaintext.
+    // Lets us measure framing + TUN cost without any crypto.
+    class NullCipher : public ICipherStrategy {
+    public:
+        bool configureContext(SSL_CTX* ctx) override;
+        bool usesTls() const override { return false; }
+    };
+
+}
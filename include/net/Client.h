@@ -1,6 +1,7 @@
 #pragma once
 #include "../crypto/ICipherStrategy.h" 
 #include "../storage/IKeyStore.h" 
+#include "IPacketDevice.h"
 #include <string> 
 
 namespace tls {
@@ -10,6 +11,8 @@ public:
     Client(ICipherStrategy* cs, IKeyStore* ks,
            const std::string& host, int port,
            const std::string& tunName = "");
+    // use `dev` instead of opening a TUN (tools, replay); not owned
+    void setDevice(IPacketDevice* dev) { _dev = dev; }
     bool run();
 
 private:
@@ -18,6 +21,7 @@ private:
     std::string _host;
     int _port;
     std::string _tunName;
+    IPacketDevice* _dev = nullptr;
 };
 
 }
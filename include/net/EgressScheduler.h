@@ -0,0 +1,62 @@
+#pragma once
+#include "TokenBucket.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace tls {
+
+struct ShaperConfig {
+    uint64_t sessionRate  = 0;    // bytes/s per session, 0 = unlimited
+    uint64_t sessionBurst = 0;    // bytes
+    uint64_t globalRate   = 0;    // bytes/s for all sessions together
+    uint64_t globalBurst  = 0;
+    uint32_t quantum      = 1500; // DRR quantum, bytes per round
+    size_t   queueLimit   = 512;  // packets per session, tail drop above
+};
+
+// Server TUN->TLS side: per-session queues served by deficit round robin,
+// each packet gated by the session bucket and the global bucket. Queues are
+// under _mu; token buckets are lock-free and consulted outside it.
+class EgressScheduler {
+public:
+    explicit EgressScheduler(const ShaperConfig& cfg = ShaperConfig());
+
+    void addSession(uint32_t id);
+    void removeSession(uint32_t id);
+
+    // Blocked sessions keep queueing but are skipped by next(), e.g. while
+    // their socket cannot take more data.
+    void setBlocked(uint32_t id, bool blocked);
+
+    // false -> packet dropped (unknown session or queue full)
+    bool enqueue(uint32_t id, const uint8_t* data, size_t len);
+
+    // Blocks until some session may send; false after stop().
+    bool next(uint32_t& id, std::vector<uint8_t>& pkt);
+    void stop();
+
+private:
+    struct Queue {
+        std::deque<std::vector<uint8_t>> packets;
+        uint64_t deficit = 0;
+        bool inTurn = false;
+        bool active = false;
+        bool blocked = false;
+        std::shared_ptr<TokenBucket> bucket;   // used by next() outside _mu
+    };
+
+    ShaperConfig _cfg;
+    TokenBucket _global;
+    std::mutex _mu;
+    std::condition_variable _cv;
+    std::map<uint32_t, Queue> _queues;
+    std::deque<uint32_t> _active;    // DRR ring of sessions with pending packets
+    bool _stopped = false;
+};
+
+}
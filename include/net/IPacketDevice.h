@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+
+namespace tls {
+
+// Source/sink of inner IP packets for Client/Server. Tun in production,
+// in-memory devices in tools. readPacket() <= 0 ends the tunnel.
+class IPacketDevice {
+public:
+    virtual ~IPacketDevice() = default;
+    virtual ssize_t readPacket(uint8_t* buf, size_t cap) = 0;
+    virtual ssize_t writePacket(const uint8_t* buf, size_t len) = 0;
+    virtual const std::string& ifname() const = 0;
+    // pollable descriptor for event-loop servers, -1 if the device has none
+    virtual int fd() const { return -1; }
+};
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "../crypto/ICipherStrategy.h"
+#include "../storage/IKeyStore.h"
+#include "IPacketDevice.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace tls {
+
+    class Tun;
+
+    // Server for very many mostly idle sessions: one epoll thread for the
+    // listener, the device and every session, non-blocking TLS, OpenSSL
+    // buffers released when idle, per-session buffers only while data is
+    // in flight. No egress shaping (that lives in Server).
+    class LeanServer {
+    public:
+        LeanServer(ICipherStrategy* cs, IKeyStore* ks, int port,
+                   const std::string& certFile, const std::string& keyFile,
+                   const std::string& tunName = "");
+        ~LeanServer();
+        // use `dev` instead of opening a TUN; it must provide fd()
+        void setDevice(IPacketDevice* dev) { _dev = dev; }
+        bool run();
+        bool listening() const { return _running.load(); }
+
+    private:
+        struct Session;
+
+        SSL_CTX* makeContext();
+        void refreshContext();
+        void acceptAll();
+        void onSessionEvent(Session* s, uint32_t events);
+        void handshake(Session* s);
+        void readFrames(Session* s);
+        void deliver(Session* s, const uint8_t* pkt, size_t len);
+        void flushTx(Session* s);
+        void deviceToSessions();
+        void sendFrame(Session* s, uint8_t* frame, size_t len);
+        void setWantWrite(Session* s, bool on);
+        void setAcceptPaused(bool paused);
+        void closeSession(Session* s);
+
+        ICipherStrategy* _cs;
+        IKeyStore* _ks;
+        int _port;
+        std::string _certFile;
+        std::string _keyFile;
+        std::string _tunName;
+
+        SSL_CTX* _ctx = nullptr;
+        uint64_t _ctxGeneration = 0;
+        std::unique_ptr<Tun> _ownTun;
+        IPacketDevice* _dev = nullptr;
+        IPacketDevice* _tun = nullptr;
+        int _listenFd = -1;
+        int _epollFd = -1;
+        bool _acceptPaused = false;
+        std::atomic<bool> _running{false};
+
+        std::unordered_set<Session*> _sessions;
+        std::vector<Session*> _closing;
+        std::unordered_map<uint32_t, Session*> _routes;  // inner IPv4 (net order) -> session
+        std::vector<uint8_t> _scratch;                   // one frame, shared by all sessions
+    };
+
+}
@@ -1,23 +1,71 @@
 #pragma once
 #include "../crypto/ICipherStrategy.h" 
 #include "../storage/IKeyStore.h"
+#include "EgressScheduler.h"
+#include "IPacketDevice.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string> 
 
 namespace tls {
 
+    class Tun;
+
     class Server {
     public:
     	Server(ICipherStrategy* cs, IKeyStore* ks, int port,
            	const std::string& certFile, const std::string& keyFile,
-           	const std::string& tunName = "");
+           	const std::string& tunName = "",
+           	const ShaperConfig& shaper = ShaperConfig());
+    	~Server();
+    	// use `dev` instead of opening a TUN (tools, replay); not owned
+    	void setDevice(IPacketDevice* dev) { _dev = dev; }
+    	// off: forward any inner source address (replaying multi-host captures)
+    	void setSourceCheck(bool on) { _sourceCheck = on; }
     	bool run();
+    	// true once listening with the device up, until run() winds down
+    	bool listening() const { return _running.load(); }
     private:
+        struct Session;
+
+        SSL_CTX* makeContext();
+        void refreshContext();                           // pick up new key material
+
+        void serveSession(std::shared_ptr<Session> s);   // handshake + TLS -> TUN
+        void tunToSessions();                            // TUN -> per-session queues
+        void egressLoop();                               // DRR queues -> session outboxes
+        void sessionWriter(std::shared_ptr<Session> s);  // outbox -> TLS, may block
+        bool bindInnerAddr(Session& s, uint32_t addr);   // pin addr to s unless taken
+        void dropSession(uint32_t id);
+
         ICipherStrategy* _cs;
         IKeyStore* _ks;
         int _port;
         std::string _certFile;
         std::string _keyFile;
 	std::string _tunName;
+
+        SSL_CTX* _ctx = nullptr;                         // for new handshakes only
+        uint64_t _ctxGeneration = 0;
+        std::unique_ptr<Tun> _ownTun;
+        IPacketDevice* _dev = nullptr;
+        IPacketDevice* _tun = nullptr;
+        int _listenFd = -1;
+        std::atomic<bool> _running{false};
+        bool _sourceCheck = true;
+
+        EgressScheduler _sched;
+        std::mutex _mu;
+        std::map<uint32_t, std::shared_ptr<Session>> _sessions;
+        std::map<uint32_t, uint32_t> _routes;            // inner IPv4 (net order) -> owning session id
+        std::map<uint32_t, int> _liveFds;                // every accepted socket, incl. mid-handshake
+        uint32_t _nextId = 1;
+        int _liveThreads = 0;
+        std::condition_variable _threadsDone;
     };
 
 }
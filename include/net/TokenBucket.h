@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace tls {
+
+// Token bucket in bytes. rate == 0 means unlimited.
+// Refill and consume are CAS loops on atomics, no mutex.
+class TokenBucket {
+public:
+    explicit TokenBucket(uint64_t rateBytesPerSec = 0, uint64_t burstBytes = 0);
+
+    void configure(uint64_t rateBytesPerSec, uint64_t burstBytes);
+    bool unlimited() const { return _rate == 0; }
+
+    bool tryConsume(uint64_t bytes, uint64_t nowNs);
+    void refund(uint64_t bytes);
+    // ns until `bytes` tokens are available (0 if already there)
+    uint64_t waitNs(uint64_t bytes, uint64_t nowNs);
+
+    static uint64_t nowNs();
+
+private:
+    void refill(uint64_t nowNs);
+
+    uint64_t _rate = 0;
+    uint64_t _burst = 0;
+    uint64_t _fillNs = 0;            // time to fill an empty bucket
+    std::atomic<int64_t>  _tokens{0};
+    std::atomic<uint64_t> _lastNs{0};
+};
+
+}
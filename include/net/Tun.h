@@ -1,19 +1,20 @@
 #pragma once
+#include "IPacketDevice.h"
 #include <string>
 #include <cstdint>
 
 namespace tls {
 
-class Tun {
+class Tun : public IPacketDevice {
 public:
     explicit Tun(const std::string& name = "");
-    ~Tun();
+    ~Tun() override;
 
-    int fd() const { return _fd; }
-    const std::string& ifname() const { return _ifname; }
+    int fd() const override { return _fd; }
+    const std::string& ifname() const override { return _ifname; }
 
-    ssize_t readPacket(uint8_t* buf, size_t cap);
-    ssize_t writePacket(const uint8_t* buf, size_t len);
+    ssize_t readPacket(uint8_t* buf, size_t cap) override;
+    ssize_t writePacket(const uint8_t* buf, size_t len) override;
 
 private:
     int _fd = -1;
@@ -2,39 +2,113 @@
 #include <openssl/ssl.h>
 #include <string>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <atomic>
 #include <cctype>
 #include <cstdint>
+#include <cstring>
+#include <vector>
 #include <unistd.h>
 
 namespace tls {
 
-inline bool sendWithLength(SSL* ssl, const uint8_t* data, size_t len) {
-    uint32_t lenNet = htonl(static_cast<uint32_t>(len));
-    if (SSL_write(ssl, &lenNet, 4) != 4) return false;
+// Per-packet logging in Client/Server costs more than the crypto itself;
+// benchmarking tools switch it off.
+inline std::atomic<bool>& packetLogging() {
+    static std::atomic<bool> on{true};
+    return on;
+}
+
+// A peer that lost its network or NAT mapping never sends FIN/RST. Let the
+// kernel probe idle sessions and give up on unacknowledged data, so such a
+// session is closed within a few minutes instead of holding its inner
+// address forever.
+inline void setDeadPeerTimeouts(int fd) {
+    int on = 1, idle = 60, interval = 10, probes = 6;
+    unsigned int userTimeoutMs = 120 * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeoutMs, sizeof(userTimeoutMs));
+}
+
+// Frames are whole packets, sent as soon as they are ready; Nagle would
+// only add delayed-ACK stalls to a tunnel.
+inline void setNoDelay(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// Byte stream under the framing: TLS when ssl is set, plain TCP socket
+// otherwise (NullCipher).
+struct Channel {
+    SSL* ssl;
+    int  fd;
+
+    explicit Channel(SSL* s, int f = -1) : ssl(s), fd(f) {}
+
+    int write(const void* p, int n) {
+        if (ssl) return SSL_write(ssl, p, n);
+        return static_cast<int>(::send(fd, p, n, MSG_NOSIGNAL));
+    }
+    int read(void* p, int n) {
+        if (ssl) return SSL_read(ssl, p, n);
+        return static_cast<int>(::recv(fd, p, n, 0));
+    }
+};
+
+inline bool writeAll(Channel& ch, const uint8_t* data, size_t len) {
     size_t total = 0;
     while (total < len) {
-        int n = SSL_write(ssl, data + total, static_cast<int>(len - total));
+        int n = ch.write(data + total, static_cast<int>(len - total));
         if (n <= 0) return false;
         total += n;
     }
     return true;
 }
 
-inline bool receiveWithLength(SSL* ssl, std::string& data) {
-    uint32_t lenNet = 0;
-    int r = SSL_read(ssl, &lenNet, 4);
-    if (r != 4) return false;
-    uint32_t len = ntohl(lenNet);
-    if (len > (16 * 1024 * 1024)) return false;
-    data.resize(len);
-
+inline bool readAll(Channel& ch, uint8_t* data, size_t len) {
     size_t total = 0;
     while (total < len) {
-        int n = SSL_read(ssl, &data[total], static_cast<int>(len - total));
+        int n = ch.read(data + total, static_cast<int>(len - total));
         if (n <= 0) return false;
         total += n;
     }
     return true;
 }
 
+// Header and payload go out in one write (one TLS record, one segment):
+// with two writes Nagle holds the payload until the header is acked.
+inline bool sendWithLength(Channel& ch, const uint8_t* data, size_t len) {
+    static thread_local std::vector<uint8_t> frame;
+    frame.resize(4 + len);
+    uint32_t lenNet = htonl(static_cast<uint32_t>(len));
+    memcpy(frame.data(), &lenNet, 4);
+    if (len) memcpy(frame.data() + 4, data, len);
+    return writeAll(ch, frame.data(), frame.size());
+}
+
+inline bool receiveWithLength(Channel& ch, std::string& data) {
+    uint32_t lenNet = 0;
+    if (!readAll(ch, reinterpret_cast<uint8_t*>(&lenNet), 4)) return false;
+    uint32_t len = ntohl(lenNet);
+    if (len > (16 * 1024 * 1024)) return false;
+    data.resize(len);
+    if (len == 0) return true;
+    return readAll(ch, reinterpret_cast<uint8_t*>(&data[0]), len);
+}
+
+inline bool sendWithLength(SSL* ssl, const uint8_t* data, size_t len) {
+    Channel ch(ssl);
+    return sendWithLength(ch, data, len);
+}
+
+inline bool receiveWithLength(SSL* ssl, std::string& data) {
+    Channel ch(ssl);
+    return receiveWithLength(ch, data);
+}
+
 }
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace tls {
+
+struct PcapPacket {
+    uint64_t tsNs = 0;              // capture timestamp, 0 if the block has none
+    std::vector<uint8_t> data;      // inner IPv4/IPv6 packet, link header stripped
+};
+
+// Loads a whole pcap or pcapng capture into memory, keeping only IP packets.
+// Supported link types: RAW/IPV4/IPV6, Ethernet (+802.1Q), Linux SLL/SLL2, BSD loopback.
+class PcapFile {
+public:
+    bool load(const std::string& path);
+
+    const std::vector<PcapPacket>& packets() const { return _packets; }
+    size_t skipped() const { return _skipped; }
+    const std::string& error() const { return _error; }
+
+private:
+    bool parsePcap(const std::vector<uint8_t>& f);
+    bool parsePcapng(const std::vector<uint8_t>& f);
+    void addFrame(uint32_t linkType, uint64_t tsNs, const uint8_t* p, size_t len);
+    bool fail(const std::string& msg) { _error = msg; return false; }
+
+    std::vector<PcapPacket> _packets;
+    size_t _skipped = 0;
+    std::string _error;
+};
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "../net/IPacketDevice.h"
+#include "PcapFile.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace tls {
+
+// Server side of a replay: every packet that leaves the tunnel is queued
+// and handed straight back, so it makes the full round trip.
+class EchoDevice : public IPacketDevice {
+public:
+    ssize_t readPacket(uint8_t* buf, size_t cap) override;
+    ssize_t writePacket(const uint8_t* buf, size_t len) override;
+    const std::string& ifname() const override { return _name; }
+
+    void close();    // pending and future reads return 0
+
+private:
+    std::string _name = "echo";
+    std::mutex _mu;
+    std::condition_variable _cv;
+    std::deque<std::vector<uint8_t>> _queue;
+    bool _closed = false;
+};
+
+struct ReplayReport {
+    size_t   sent = 0;
+    size_t   received = 0;
+    size_t   lost = 0;
+    size_t   mismatched = 0;     // came back but matches nothing we sent
+    uint64_t bytes = 0;          // inner IP bytes that came back intact
+    uint64_t elapsedNs = 0;      // first send -> last receive
+    std::vector<uint64_t> latencyNs;
+};
+
+// Client side of a replay: feeds the capture into the tunnel (at capture
+// timing or back to back) and checks what comes back byte for byte.
+class ReplaySource : public IPacketDevice {
+public:
+    ReplaySource(const std::vector<PcapPacket>& packets, bool originalTiming,
+                 size_t window = 256,
+                 std::chrono::milliseconds drain = std::chrono::milliseconds(2000));
+
+    ssize_t readPacket(uint8_t* buf, size_t cap) override;
+    ssize_t writePacket(const uint8_t* buf, size_t len) override;
+    const std::string& ifname() const override { return _name; }
+
+    ReplayReport report();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    std::string _name = "replay";
+    const std::vector<PcapPacket>& _packets;
+    bool _originalTiming;
+    size_t _window;
+    std::chrono::milliseconds _drain;
+
+    std::mutex _mu;
+    std::condition_variable _cv;
+    size_t _next = 0;            // next packet to send
+    size_t _matchPos = 0;        // oldest packet not yet seen back (or given up)
+    std::vector<Clock::time_point> _sentAt;
+    Clock::time_point _start, _lastRecv;
+    ReplayReport _rep;
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <openssl/ssl.h> 
+#include <cstdint>
 #include <string> 
 
 namespace tls {
@@ -9,6 +10,13 @@ public:
     virtual ~IKeyStore() = default; 
     virtual bool loadCertificate(SSL_CTX* ctx, const std::string& certFile) = 0; 
     virtual bool loadPrivateKey(SSL_CTX* ctx, const std::string& keyFile) = 0; 
+    // both halves for one context; stores that swap material at runtime
+    // override it so cert and key come from the same version
+    virtual bool loadKeyPair(SSL_CTX* ctx, const std::string& certFile, const std::string& keyFile) {
+        return loadCertificate(ctx, certFile) && loadPrivateKey(ctx, keyFile);
+    }
+    // changes when new key material is available; Server rebuilds its SSL_CTX
+    virtual uint64_t generation() const { return 0; }
 };
 
-}
\ No newline at end of file
+}
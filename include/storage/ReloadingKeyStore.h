@@ -0,0 +1,54 @@
+#pragma once
+#include "IKeyStore.h"
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tls {
+
+// Like FileKeyStore, but keeps the parsed certificate/key in memory and
+// watches both files with inotify. New material is parsed and checked on
+// the watcher thread; generation() changes only after a valid pair is in.
+class ReloadingKeyStore : public IKeyStore {
+public:
+    ReloadingKeyStore() = default;
+    ~ReloadingKeyStore() override;
+
+    bool loadCertificate(SSL_CTX* ctx, const std::string& certFile) override;
+    bool loadPrivateKey(SSL_CTX* ctx, const std::string& keyFile) override;
+    bool loadKeyPair(SSL_CTX* ctx, const std::string& certFile, const std::string& keyFile) override;
+    uint64_t generation() const override { return _generation.load(); }
+
+private:
+    struct Material {
+        X509* cert = nullptr;
+        EVP_PKEY* key = nullptr;
+        std::string certPem, keyPem;              // raw file bytes, cheapest change check
+        std::vector<uint8_t> certDer, keyDer;     // canonical form, ignores PEM reformatting
+        ~Material();
+    };
+
+    std::shared_ptr<Material> current() const;
+    bool loadPair(std::shared_ptr<Material>& out, bool initial);
+    void startWatcher();
+    void watchLoop();
+    void reload();
+
+    std::string _certFile;
+    std::string _keyFile;
+
+    mutable std::mutex _mu;                        // guards _material pointer swap
+    std::shared_ptr<Material> _material;
+    std::atomic<uint64_t> _generation{0};
+
+    int _inotifyFd = -1;
+    int _stopFd = -1;
+    std::thread _watcher;
+};
+
+}
@@ -0,0 +1,64 @@
+#include "crypto/BaselineCipher.h"
+#include <openssl/err.h>
+#include <cstdio>
+
+namespace tls {
+
+std::vector<std::string> BaselineCipher::supportedSuites() {
+    return {
+        "TLS_AES_128_GCM_SHA256",
+        "TLS_AES_256_GCM_SHA384",
+        "TLS_CHACHA20_POLY1305_SHA256"
+    };
+}
+
+BaselineCipher::BaselineCipher(IProviderLoader* loader, const std::string& algorithm)
+    : _loader(loader), _algorithm(algorithm.empty() ? "baseline" : algorithm) {}
+
+BaselineCipher::~BaselineCipher() {
+    if (_default) _loader->unloadProvider(_default);
+}
+
+bool BaselineCipher::configureContext(SSL_CTX* ctx) {
+    if (!_default) _default = _loader->loadProvider("default");
+    if (!_default) {
+        fprintf(stderr, "Failed to load default provider\n");
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION);
+    SSL_CTX_set_max_proto_version(ctx, TLS1_3_VERSION);
+
+    std::string cipherList;
+    auto suites = supportedSuites();
+
+    if (_algorithm == "baseline") {
+        for (size_t i = 0; i < suites.size(); ++i) {
+            cipherList += suites[i];
+            if (i + 1 < suites.size()) cipherList += ":";
+        }
+    } else {
+        bool found = false;
+        for (auto& s : suites) {
+            if (s == _algorithm) {
+                cipherList = s;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unsupported cipher suite: %s\n", _algorithm.c_str());
+            return false;
+        }
+    }
+
+    printf("Configuring baseline TLS1.3 ciphersuites: %s\n", cipherList.c_str());
+    if (SSL_CTX_set_ciphersuites(ctx, cipherList.c_str()) != 1) {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,23 @@
+#include "crypto/CipherFactory.h"
+#include "crypto/BaselineCipher.h"
+#include "crypto/GostCipher.h"
+#include "crypto/NullCipher.h"
+
+namespace tls {
+
+std::unique_ptr<ICipherStrategy> makeCipherStrategy(IProviderLoader* loader,
+                                                    const std::string& algorithm) {
+    if (algorithm == "null")
+        return std::unique_ptr<ICipherStrategy>(new NullCipher());
+
+    if (algorithm == "baseline")
+        return std::unique_ptr<ICipherStrategy>(new BaselineCipher(loader, algorithm));
+    for (auto& s : BaselineCipher::supportedSuites()) {
+        if (s == algorithm)
+            return std::unique_ptr<ICipherStrategy>(new BaselineCipher(loader, algorithm));
+    }
+
+    return std::unique_ptr<ICipherStrategy>(new GostCipher(loader, algorithm));
+}
+
+}
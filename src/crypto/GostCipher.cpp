@@ -22,8 +22,9 @@ GostCipher::~GostCipher() {
 }
 
 bool GostCipher::configureContext(SSL_CTX* ctx) {
-    _default = _loader->loadProvider("default");
-    _gost    = _loader->loadProvider("gostprov");
+    // the server configures a fresh SSL_CTX on key reload, providers stay loaded
+    if (!_default) _default = _loader->loadProvider("default");
+    if (!_gost)    _gost    = _loader->loadProvider("gostprov");
 
     if (!_gost) {
         fprintf(stderr, "Failed to load GOST provider\n");
@@ -0,0 +1,11 @@
+#include "crypto/NullCipher.h"
+#include <cstdio>
+
+namespace tls {
+
+bool NullCipher::configureContext(SSL_CTX*) {
+    printf("WARNING: null cipher, tunnel traffic is NOT encrypted\n");
+    return true;
+}
+
+}
@@ -1,13 +1,17 @@
 #include "net/Client.h"
-#include "crypto/GostCipher.h"
+#include "crypto/CipherFactory.h"
 #include "provider/ProviderLoader.h"
 #include "storage/FileKeyStore.h"
 
 #include <getopt.h>
+#include <signal.h>
 #include <iostream>
 #include <string>
 
 int main(int argc, char* argv[]) {
+    // a peer that already closed must fail the write, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
     std::string host = "127.0.0.1";
     int         port = 4433;
     std::string algorithm = "any";
@@ -43,8 +47,8 @@ int main(int argc, char* argv[]) {
 
     tls::ProviderLoader loader;
     tls::FileKeyStore   ks;
-    tls::GostCipher     gost(&loader, algorithm);
+    auto cipher = tls::makeCipherStrategy(&loader, algorithm);
 
-    tls::Client cli(&gost, &ks, host, port, tunName);
+    tls::Client cli(cipher.get(), &ks, host, port, tunName);
     return cli.run() ? 0 : 1;
 }
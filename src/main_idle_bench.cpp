@@ -0,0 +1,242 @@
+#include "net/LeanServer.h"
+#include "net/Server.h"
+#include "net/Utils.h"
+#include "crypto/CipherFactory.h"
+#include "provider/ProviderLoader.h"
+#include "storage/FileKeyStore.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Never produces a packet: the benchmark only holds idle sessions.
+class IdleDevice : public tls::IPacketDevice {
+public:
+    IdleDevice() : _fd(eventfd(0, EFD_CLOEXEC)) {}
+    ~IdleDevice() override { if (_fd >= 0) close(_fd); }
+    ssize_t readPacket(uint8_t* buf, size_t cap) override { return read(_fd, buf, cap < 8 ? 8 : cap); }
+    ssize_t writePacket(const uint8_t*, size_t len) override { return static_cast<ssize_t>(len); }
+    const std::string& ifname() const override { return _name; }
+    int fd() const override { return _fd; }
+private:
+    int _fd;
+    std::string _name = "idle";
+};
+
+static long rssKb(pid_t pid) {
+    std::ifstream in("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) return std::stol(line.substr(6));
+    }
+    return -1;
+}
+
+static long threadCount(pid_t pid) {
+    std::ifstream in("/proc/" + std::to_string(pid) + "/status");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 8, "Threads:") == 0) return std::stol(line.substr(8));
+    }
+    return -1;
+}
+
+// 127.0.0.1 has ~28k ephemeral ports; spread sources over 127.1.x.1
+static int connectFrom(size_t i, int port) {
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0) return -1;
+    sockaddr_in src{};
+    src.sin_family = AF_INET;
+    src.sin_addr.s_addr = htonl(0x7f010001 + static_cast<uint32_t>(i / 20000) * 0x100);
+    sockaddr_in dst{};
+    dst.sin_family = AF_INET;
+    dst.sin_port = htons(port);
+    dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    // a server that stopped accepting must fail the handshake, not hang it
+    timeval tv{10, 0};
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (bind(s, (sockaddr*)&src, sizeof(src)) < 0 || connect(s, (sockaddr*)&dst, sizeof(dst)) < 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static int runServer(const std::string& mode, const std::string& algo, int port,
+                     const std::string& cert, const std::string& key, int readyFd) {
+    tls::packetLogging() = false;
+    tls::ProviderLoader loader;
+    tls::FileKeyStore ks;
+    auto cipher = tls::makeCipherStrategy(&loader, algo);
+    IdleDevice dev;
+
+    std::unique_ptr<tls::LeanServer> lean;
+    std::unique_ptr<tls::Server> threaded;
+    if (mode == "lean") {
+        lean.reset(new tls::LeanServer(cipher.get(), &ks, port, cert, key));
+        lean->setDevice(&dev);
+    } else {
+        threaded.reset(new tls::Server(cipher.get(), &ks, port, cert, key));
+        threaded->setDevice(&dev);
+    }
+
+    std::thread ready([&] {
+        while (!(lean ? lean->listening() : threaded->listening()))
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        char c = 1;
+        if (write(readyFd, &c, 1) != 1) perror("write(ready)");
+    });
+    ready.detach();
+    return (lean ? lean->run() : threaded->run()) ? 0 : 2;
+}
+
+int main(int argc, char* argv[]) {
+    // clients are torn down while the server still writes
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string algo = "any";
+    std::string cert = "certs/cert.pem";
+    std::string key  = "certs/key.pem";
+    std::string mode = "lean";
+    std::string countsArg = "1000,10000,50000";
+    int port = 4466;
+
+    static option opts[] = {
+        {"cipher", required_argument, nullptr, 'c'},
+        {"cert",   required_argument, nullptr, 't'},
+        {"key",    required_argument, nullptr, 'k'},
+        {"port",   required_argument, nullptr, 'p'},
+        {"mode",   required_argument, nullptr, 'm'},
+        {"counts", required_argument, nullptr, 'n'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int o;
+    while ((o = getopt_long(argc, argv, "c:t:k:p:m:n:", opts, nullptr)) != -1) {
+        switch (o) {
+            case 'c': algo = optarg; break;
+            case 't': cert = optarg; break;
+            case 'k': key  = optarg; break;
+            case 'p': port = std::stoi(optarg); break;
+            case 'm': mode = optarg; break;
+            case 'n': countsArg = optarg; break;
+            default: mode.clear(); break;
+        }
+    }
+    std::vector<size_t> counts;
+    std::stringstream ss(countsArg);
+    for (std::string c; std::getline(ss, c, ',');) counts.push_back(std::stoul(c));
+    if ((mode != "lean" && mode != "threaded") || counts.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--mode lean|threaded] [--counts 1000,10000,50000] [--cipher name]"
+                  << " [--cert cert.pem] [--key key.pem] [--port n]\n";
+        return 2;
+    }
+    size_t maxCount = 0;
+    for (size_t c : counts) maxCount = std::max(maxCount, c);
+
+    // both sides hold one descriptor per session
+    rlimit rl{};
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rlim_t need = maxCount + 256;
+    if (rl.rlim_cur < need) {
+        rlimit want = rl;
+        want.rlim_cur = need;
+        if (want.rlim_max < need) want.rlim_max = need;
+        if (setrlimit(RLIMIT_NOFILE, &want) == 0) {
+            rl = want;
+        } else {
+            // unprivileged: go as far as the hard limit allows
+            perror("[bench] setrlimit(RLIMIT_NOFILE)");
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+    size_t fdCap = rl.rlim_cur > 256 ? rl.rlim_cur - 256 : 0;
+
+    int ready[2];
+    if (pipe(ready) < 0) { perror("pipe"); return 2; }
+    pid_t child = fork();
+    if (child < 0) { perror("fork"); return 2; }
+    if (child == 0) {
+        close(ready[0]);
+        _exit(runServer(mode, algo, port, cert, key, ready[1]));
+    }
+    close(ready[1]);
+    char c;
+    if (read(ready[0], &c, 1) != 1) {
+        fprintf(stderr, "[bench] server failed to start\n");
+        waitpid(child, nullptr, 0);
+        return 2;
+    }
+    close(ready[0]);
+
+    tls::ProviderLoader loader;
+    auto cipher = tls::makeCipherStrategy(&loader, algo);
+    SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+    if (!ctx || !cipher->configureContext(ctx)) {
+        kill(child, SIGTERM); waitpid(child, nullptr, 0);
+        return 2;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long baseKb = rssKb(child);
+    printf("[bench] mode=%s cipher=%s server pid=%d baseline rss=%ld KiB\n",
+           mode.c_str(), algo.c_str(), (int)child, baseKb);
+    printf("%10s %12s %14s %10s\n", "sessions", "rss_MiB", "per_session_B", "threads");
+
+    std::vector<int> fds;
+    fds.reserve(maxCount);
+    int rc = 0;
+    for (size_t target : counts) {
+        if (target > fdCap) {
+            printf("%10zu %12s %14s %10s  (RLIMIT_NOFILE=%llu, raise the hard limit)\n",
+                   target, "-", "-", "-", static_cast<unsigned long long>(rl.rlim_cur));
+            continue;
+        }
+        while (fds.size() < target) {
+            int s = connectFrom(fds.size(), port);
+            if (s < 0) { perror("[bench] connect"); rc = 1; break; }
+            if (cipher->usesTls()) {
+                // handshake, then drop the client SSL: the server side stays
+                // an idle TLS session, the benchmark process stays small
+                SSL* ssl = SSL_new(ctx);
+                SSL_set_fd(ssl, s);
+                bool ok = SSL_connect(ssl) == 1;
+                SSL_free(ssl);
+                if (!ok) { ERR_print_errors_fp(stderr); close(s); rc = 1; break; }
+            }
+            fds.push_back(s);
+        }
+        if (rc) break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        long kb = rssKb(child);
+        if (kb < 0) { fprintf(stderr, "[bench] server died\n"); rc = 1; break; }
+        printf("%10zu %12.1f %14.0f %10ld\n", fds.size(), kb / 1024.0,
+               (kb - baseKb) * 1024.0 / fds.size(), threadCount(child));
+        fflush(stdout);
+    }
+
+    for (int s : fds) close(s);
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+    SSL_CTX_free(ctx);
+    return rc;
+}
@@ -0,0 +1,165 @@
+#include "net/Client.h"
+#include "net/Server.h"
+#include "net/Utils.h"
+#include "crypto/CipherFactory.h"
+#include "provider/ProviderLoader.h"
+#include "replay/PcapFile.h"
+#include "replay/ReplayDevices.h"
+#include "storage/FileKeyStore.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+
+static double percentileUs(const std::vector<uint64_t>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    size_t i = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[i] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    // the server may close first; SSL_shutdown must not kill the tool
+    signal(SIGPIPE, SIG_IGN);
+
+    std::string pcap;
+    std::string algo = "any";
+    std::string cert = "certs/cert.pem";
+    std::string key  = "certs/key.pem";
+    std::string timing = "fast";
+    int port = 4455;
+    size_t window = 256;
+    long expectPackets = -1;        // parser checks for fixtures, -1: any
+    long expectSkipped = -1;
+    long expectSpanMs = -1;         // first to last capture timestamp
+
+    static option opts[] = {
+        {"pcap",   required_argument, nullptr, 'f'},
+        {"cipher", required_argument, nullptr, 'c'},
+        {"cert",   required_argument, nullptr, 't'},
+        {"key",    required_argument, nullptr, 'k'},
+        {"port",   required_argument, nullptr, 'p'},
+        {"timing", required_argument, nullptr, 'm'},
+        {"window", required_argument, nullptr, 'w'},
+        {"expect-packets", required_argument, nullptr, 1000},
+        {"expect-skipped", required_argument, nullptr, 1001},
+        {"expect-span-ms", required_argument, nullptr, 1002},
+        {nullptr, 0, nullptr, 0}
+    };
+    int o;
+    while ((o = getopt_long(argc, argv, "f:c:t:k:p:m:w:", opts, nullptr)) != -1) {
+        switch (o) {
+            case 'f': pcap   = optarg; break;
+            case 'c': algo   = optarg; break;
+            case 't': cert   = optarg; break;
+            case 'k': key    = optarg; break;
+            case 'p': port   = std::stoi(optarg); break;
+            case 'm': timing = optarg; break;
+            case 'w': window = std::stoul(optarg); break;
+            case 1000: expectPackets = std::stol(optarg); break;
+            case 1001: expectSkipped = std::stol(optarg); break;
+            case 1002: expectSpanMs  = std::stol(optarg); break;
+            default: pcap.clear(); optind = argc; break;
+        }
+    }
+    if (pcap.empty() || (timing != "fast" && timing != "original")) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --pcap file.pcap[ng] [--cipher name] [--cert cert.pem] [--key key.pem]"
+                  << " [--port n] [--timing fast|original] [--window n]"
+                  << " [--expect-packets n] [--expect-skipped n] [--expect-span-ms n]\n";
+        return 2;
+    }
+
+    tls::PcapFile capture;
+    if (!capture.load(pcap)) {
+        fprintf(stderr, "[replay] %s: %s\n", pcap.c_str(), capture.error().c_str());
+        return 2;
+    }
+    if (capture.packets().empty()) {
+        fprintf(stderr, "[replay] %s: no IP packets\n", pcap.c_str());
+        return 2;
+    }
+    uint64_t firstNs = capture.packets().front().tsNs, lastNs = firstNs;
+    for (const tls::PcapPacket& p : capture.packets()) {
+        firstNs = std::min(firstNs, p.tsNs);
+        lastNs  = std::max(lastNs, p.tsNs);
+    }
+    double spanMs = (lastNs - firstNs) / 1e6;
+    printf("[replay] %s: %zu IP packets, %zu skipped, span %.3fs, cipher '%s', timing %s\n",
+           pcap.c_str(), capture.packets().size(), capture.skipped(), spanMs / 1e3,
+           algo.c_str(), timing.c_str());
+    bool parsedOk = true;
+    if (expectPackets >= 0 && capture.packets().size() != (size_t)expectPackets) {
+        fprintf(stderr, "[replay] expected %ld IP packets\n", expectPackets);
+        parsedOk = false;
+    }
+    if (expectSkipped >= 0 && capture.skipped() != (size_t)expectSkipped) {
+        fprintf(stderr, "[replay] expected %ld skipped\n", expectSkipped);
+        parsedOk = false;
+    }
+    if (expectSpanMs >= 0 && (spanMs < expectSpanMs - 1 || spanMs > expectSpanMs + 1)) {
+        fprintf(stderr, "[replay] expected a %ld ms span\n", expectSpanMs);
+        parsedOk = false;
+    }
+    if (!parsedOk) {
+        printf("[replay] FAIL\n");
+        return 1;
+    }
+
+    tls::packetLogging() = false;
+
+    tls::ProviderLoader loader;
+    tls::FileKeyStore   ks;
+    auto srvCipher = tls::makeCipherStrategy(&loader, algo);
+    auto cliCipher = tls::makeCipherStrategy(&loader, algo);
+
+    tls::EchoDevice   echo;
+    tls::ReplaySource source(capture.packets(), timing == "original", window);
+
+    tls::Server server(srvCipher.get(), &ks, port, cert, key);
+    server.setDevice(&echo);
+    server.setSourceCheck(false);   // captures may hold several hosts behind one client
+    std::atomic<bool> serverDone{false};
+    std::thread srvThread([&] { server.run(); serverDone = true; });
+
+    while (!server.listening() && !serverDone.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    if (serverDone.load()) {
+        srvThread.join();
+        fprintf(stderr, "[replay] server failed to start\n");
+        return 2;
+    }
+
+    tls::Client client(cliCipher.get(), &ks, "127.0.0.1", port);
+    client.setDevice(&source);
+    bool clientOk = client.run();
+
+    echo.close();
+    srvThread.join();
+    if (!clientOk) {
+        fprintf(stderr, "[replay] client failed\n");
+        return 2;
+    }
+
+    tls::ReplayReport r = source.report();
+    std::sort(r.latencyNs.begin(), r.latencyNs.end());
+    double sec = r.elapsedNs / 1e9;
+
+    printf("[replay] sent=%zu received=%zu lost=%zu mismatched=%zu\n",
+           r.sent, r.received, r.lost, r.mismatched);
+    printf("[replay] elapsed=%.3fs throughput=%.2f Mbit/s %.0f pkt/s\n",
+           sec, sec > 0 ? r.bytes * 8 / sec / 1e6 : 0.0, sec > 0 ? r.received / sec : 0.0);
+    printf("[replay] latency us: min=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+           percentileUs(r.latencyNs, 0.0), percentileUs(r.latencyNs, 0.5),
+           percentileUs(r.latencyNs, 0.9), percentileUs(r.latencyNs, 0.99),
+           percentileUs(r.latencyNs, 0.999), percentileUs(r.latencyNs, 1.0));
+
+    bool ok = r.lost == 0 && r.mismatched == 0 && r.received == r.sent;
+    printf("[replay] %s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -1,16 +1,25 @@
+#include "net/LeanServer.h"
 #include "net/Server.h"
-#include "crypto/GostCipher.h"
+#include "crypto/CipherFactory.h"
 #include "provider/ProviderLoader.h"
 #include "storage/FileKeyStore.h"
+#include "storage/ReloadingKeyStore.h"
 #include <getopt.h>
+#include <signal.h>
 #include <iostream>
 
 int main(int argc, char* argv[]) {
+    // dropped sessions surface as send errors (EPIPE)
+    signal(SIGPIPE, SIG_IGN);
+
     int port = 4433;
     std::string algo = "any";
     std::string cert = "certs/cert.pem";
     std::string key  = "certs/key.pem";
     std::string tunName = "";
+    tls::ShaperConfig shaper;
+    bool watchKeys = false;
+    bool lean = false;
 
     static option opts[] = {
         {"port", required_argument, nullptr, 'p'},
@@ -18,6 +27,13 @@ int main(int argc, char* argv[]) {
         {"cert", required_argument, nullptr, 't'},
         {"key", required_argument, nullptr, 'k'},
         {"tun", required_argument, nullptr, 'n'},
+        {"session-rate", required_argument, nullptr, 1000},
+        {"session-burst", required_argument, nullptr, 1001},
+        {"global-rate", required_argument, nullptr, 1002},
+        {"global-burst", required_argument, nullptr, 1003},
+        {"quantum", required_argument, nullptr, 1004},
+        {"watch-keys", no_argument, nullptr, 1005},
+        {"lean", no_argument, nullptr, 1006},
         {nullptr, 0, nullptr, 0}
     };
     int o;
@@ -28,16 +44,33 @@ int main(int argc, char* argv[]) {
             case 't': cert = optarg; break;
             case 'k': key  = optarg; break;
             case 'n': tunName = optarg; break;
+            case 1000: shaper.sessionRate  = std::stoull(optarg); break;
+            case 1001: shaper.sessionBurst = std::stoull(optarg); break;
+            case 1002: shaper.globalRate   = std::stoull(optarg); break;
+            case 1003: shaper.globalBurst  = std::stoull(optarg); break;
+            case 1004: shaper.quantum      = static_cast<uint32_t>(std::stoul(optarg)); break;
+            case 1005: watchKeys = true; break;
+            case 1006: lean = true; break;
             default:
                 std::cerr << "Usage: " << argv[0]
-                          << " [--port n] [--cipher name] [--cert cert.pem] [--key key.pem] [--tun ifname]\n";
+                          << " [--port n] [--cipher name] [--cert cert.pem] [--key key.pem] [--tun ifname]"
+                          << " [--session-rate B/s] [--session-burst B] [--global-rate B/s] [--global-burst B] [--quantum B]"
+                          << " [--watch-keys] [--lean]\n";
                 return 1;
         }
     }
 
     tls::ProviderLoader loader;
-    tls::FileKeyStore ks;
-    tls::GostCipher gost(&loader, algo);
-    tls::Server app(&gost, &ks, port, cert, key, tunName);
+    tls::FileKeyStore fileKs;
+    tls::ReloadingKeyStore reloadingKs;
+    tls::IKeyStore* ks = watchKeys ? static_cast<tls::IKeyStore*>(&reloadingKs) : &fileKs;
+    auto cipher = tls::makeCipherStrategy(&loader, algo);
+    if (lean) {
+        if (shaper.sessionRate || shaper.globalRate)
+            std::cerr << "--lean: rate limiting is not supported, ignoring shaper options\n";
+        tls::LeanServer app(cipher.get(), ks, port, cert, key, tunName);
+        return app.run() ? 0 : 2;
+    }
+    tls::Server app(cipher.get(), ks, port, cert, key, tunName, shaper);
     return app.run() ? 0 : 2;
 }
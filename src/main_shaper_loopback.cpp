@@ -0,0 +1,311 @@
+#include "net/Client.h"
+#include "net/Server.h"
+#include "net/Utils.h"
+#include "crypto/CipherFactory.h"
+#include "provider/ProviderLoader.h"
+#include "storage/FileKeyStore.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <netinet/ip.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loopback check of the server's egress shaping: N clients on one Server
+// with the null cipher, in-memory devices on both ends. The server device
+// pushes traffic to every client at a fixed offered rate; each client's
+// received throughput is compared with the max-min fair share implied by
+// --session-rate / --global-rate, which is what DRR plus the buckets owe.
+// With --reconnect client 0 connects again from the same host while its
+// first session is still up (as after a lost NAT mapping): the new session
+// must take the inner address over and get the old one's share.
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t kPacketLen = 1400;
+static const uint32_t kServerAddr = 0x0a080001;    // 10.8.0.1, clients from .2 up
+
+static void fillIp(uint8_t* buf, size_t len, uint32_t saddr, uint32_t daddr) {
+    memset(buf, 0, len);
+    iphdr* ip = reinterpret_cast<iphdr*>(buf);
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len = htons(static_cast<uint16_t>(len));
+    ip->saddr = saddr;
+    ip->daddr = daddr;
+}
+
+// Server side: learns client addresses from their hello packets, then
+// generates kPacketLen packets to each of them at its offered rate.
+class TrafficHub : public tls::IPacketDevice {
+public:
+    TrafficHub(const std::vector<uint32_t>& addrs, const std::vector<double>& offered)
+        : _addrs(addrs), _offered(offered) {}
+
+    ssize_t readPacket(uint8_t* buf, size_t cap) override {
+        std::unique_lock<std::mutex> lk(_mu);
+        _cv.wait(lk, [&] { return _stopped || _seen.size() == _addrs.size(); });
+        if (_stopped || cap < kPacketLen) return 0;
+        if (_due.empty()) _due.assign(_addrs.size(), Clock::now());
+
+        for (;;) {
+            size_t i = std::min_element(_due.begin(), _due.end()) - _due.begin();
+            Clock::time_point now = Clock::now();
+            if (_due[i] > now) {
+                _cv.wait_until(lk, _due[i]);
+                if (_stopped) return 0;
+                continue;
+            }
+            // fell far behind (slow box): do not make up for it in one burst
+            if (now - _due[i] > std::chrono::milliseconds(100)) _due[i] = now;
+            _due[i] += std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(kPacketLen / _offered[i]));
+            fillIp(buf, kPacketLen, htonl(kServerAddr), _addrs[i]);
+            return kPacketLen;
+        }
+    }
+
+    ssize_t writePacket(const uint8_t* buf, size_t len) override {
+        const iphdr* ip = reinterpret_cast<const iphdr*>(buf);
+        if (len >= sizeof(iphdr) && ip->version == 4 &&
+            std::find(_addrs.begin(), _addrs.end(), ip->saddr) != _addrs.end()) {
+            std::lock_guard<std::mutex> lk(_mu);
+            _seen.insert(ip->saddr);
+            _cv.notify_all();
+        }
+        return static_cast<ssize_t>(len);
+    }
+
+    const std::string& ifname() const override { return _name; }
+
+    void stop() {
+        std::lock_guard<std::mutex> lk(_mu);
+        _stopped = true;
+        _cv.notify_all();
+    }
+
+private:
+    std::string _name = "hub";
+    std::vector<uint32_t> _addrs;
+    std::vector<double> _offered;          // bytes/s per client
+    std::vector<Clock::time_point> _due;
+    std::set<uint32_t> _seen;
+    std::mutex _mu;
+    std::condition_variable _cv;
+    bool _stopped = false;
+};
+
+// Client side: says hello once so the server pins our address, then only
+// counts what arrives.
+class CountingPeer : public tls::IPacketDevice {
+public:
+    explicit CountingPeer(uint32_t addr) : _addr(addr) {}
+
+    ssize_t readPacket(uint8_t* buf, size_t cap) override {
+        std::unique_lock<std::mutex> lk(_mu);
+        if (!_helloSent && cap >= sizeof(iphdr) + 8) {
+            _helloSent = true;
+            fillIp(buf, sizeof(iphdr) + 8, _addr, htonl(kServerAddr));
+            return sizeof(iphdr) + 8;
+        }
+        _cv.wait(lk, [&] { return _stopped; });
+        return 0;
+    }
+
+    ssize_t writePacket(const uint8_t*, size_t len) override {
+        bytes += len;
+        return static_cast<ssize_t>(len);
+    }
+
+    const std::string& ifname() const override { return _name; }
+
+    void stop() {
+        std::lock_guard<std::mutex> lk(_mu);
+        _stopped = true;
+        _cv.notify_all();
+    }
+
+    std::atomic<uint64_t> bytes{0};
+
+private:
+    std::string _name = "peer";
+    uint32_t _addr;
+    std::mutex _mu;
+    std::condition_variable _cv;
+    bool _helloSent = false;
+    bool _stopped = false;
+};
+
+// max-min fair split of `capacity` over demands capped at `caps`
+static std::vector<double> fairShares(const std::vector<double>& caps, double capacity) {
+    std::vector<size_t> order(caps.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return caps[a] < caps[b]; });
+
+    std::vector<double> share(caps.size());
+    double left = capacity;
+    for (size_t k = 0; k < order.size(); ++k) {
+        double fair = left / (order.size() - k);
+        share[order[k]] = std::min(caps[order[k]], fair);
+        left -= share[order[k]];
+    }
+    return share;
+}
+
+int main(int argc, char* argv[]) {
+    signal(SIGPIPE, SIG_IGN);
+
+    int port = 4477;
+    size_t clients = 3;
+    size_t light = 0;
+    double seconds = 2.0;
+    double tolerance = 0.15;
+    bool reconnect = false;
+    tls::ShaperConfig shaper;
+
+    static option opts[] = {
+        {"port",         required_argument, nullptr, 'p'},
+        {"clients",      required_argument, nullptr, 'n'},
+        {"light",        required_argument, nullptr, 'l'},
+        {"seconds",      required_argument, nullptr, 's'},
+        {"tolerance",    required_argument, nullptr, 'e'},
+        {"reconnect",    no_argument,       nullptr, 'r'},
+        {"session-rate", required_argument, nullptr, 1000},
+        {"global-rate",  required_argument, nullptr, 1002},
+        {"quantum",      required_argument, nullptr, 1004},
+        {nullptr, 0, nullptr, 0}
+    };
+    int o;
+    bool usage = false;
+    while ((o = getopt_long(argc, argv, "p:n:l:s:e:r", opts, nullptr)) != -1) {
+        switch (o) {
+            case 'p': port = std::stoi(optarg); break;
+            case 'n': clients = std::stoul(optarg); break;
+            case 'l': light = std::stoul(optarg); break;
+            case 's': seconds = std::stod(optarg); break;
+            case 'e': tolerance = std::stod(optarg); break;
+            case 'r': reconnect = true; break;
+            case 1000: shaper.sessionRate = std::stoull(optarg); break;
+            case 1002: shaper.globalRate  = std::stoull(optarg); break;
+            case 1004: shaper.quantum     = static_cast<uint32_t>(std::stoul(optarg)); break;
+            default: usage = true; break;
+        }
+    }
+    if (usage || clients == 0 || light > clients || (!shaper.sessionRate && !shaper.globalRate)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " (--session-rate B/s | --global-rate B/s) [--clients n] [--light n]"
+                  << " [--quantum B] [--seconds s] [--tolerance frac] [--reconnect] [--port n]\n"
+                  << "  the first --light clients are offered a quarter of the fair share,"
+                  << " the rest twice of it\n";
+        return 2;
+    }
+
+    // what each client would get with no limit in the way
+    double fair = shaper.sessionRate ? static_cast<double>(shaper.sessionRate)
+                                     : static_cast<double>(shaper.globalRate) / clients;
+    if (shaper.sessionRate && shaper.globalRate)
+        fair = std::min(fair, static_cast<double>(shaper.globalRate) / clients);
+    std::vector<uint32_t> addrs;
+    std::vector<double> offered, caps;
+    for (size_t i = 0; i < clients; ++i) {
+        addrs.push_back(htonl(kServerAddr + 1 + static_cast<uint32_t>(i)));
+        offered.push_back(i < light ? fair / 4 : fair * 2);
+        caps.push_back(shaper.sessionRate ? std::min(offered.back(), static_cast<double>(shaper.sessionRate))
+                                          : offered.back());
+    }
+    std::vector<double> expect = fairShares(caps, shaper.globalRate ? static_cast<double>(shaper.globalRate)
+                                                                    : std::numeric_limits<double>::infinity());
+
+    tls::packetLogging() = false;
+    tls::ProviderLoader loader;
+    tls::FileKeyStore ks;
+    auto srvCipher = tls::makeCipherStrategy(&loader, "null");
+
+    TrafficHub hub(addrs, offered);
+    tls::Server server(srvCipher.get(), &ks, port, "", "", "", shaper);
+    server.setDevice(&hub);
+    std::atomic<bool> serverDone{false};
+    std::thread srvThread([&] { server.run(); serverDone = true; });
+    while (!server.listening() && !serverDone.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (serverDone.load()) {
+        srvThread.join();
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<tls::ICipherStrategy>> cliCiphers;
+    std::vector<std::unique_ptr<CountingPeer>> peers;
+    std::vector<std::unique_ptr<tls::Client>> cli;
+    std::vector<std::thread> cliThreads;
+    auto connect = [&](uint32_t addr) {
+        cliCiphers.push_back(tls::makeCipherStrategy(&loader, "null"));
+        peers.emplace_back(new CountingPeer(addr));
+        cli.emplace_back(new tls::Client(cliCiphers.back().get(), &ks, "127.0.0.1", port));
+        cli.back()->setDevice(peers.back().get());
+        tls::Client* c = cli.back().get();
+        cliThreads.emplace_back([c] { c->run(); });
+        return peers.back().get();
+    };
+    std::vector<CountingPeer*> measured;
+    for (size_t i = 0; i < clients; ++i) measured.push_back(connect(addrs[i]));
+
+    // warm-up drains the initial bucket bursts and fills the queues
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    CountingPeer* stale = nullptr;
+    if (reconnect) {
+        stale = measured[0];
+        measured[0] = connect(addrs[0]);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    std::vector<uint64_t> before(clients);
+    for (size_t i = 0; i < clients; ++i) before[i] = measured[i]->bytes.load();
+    uint64_t staleBefore = stale ? stale->bytes.load() : 0;
+    Clock::time_point t0 = Clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+    std::vector<uint64_t> after(clients);
+    for (size_t i = 0; i < clients; ++i) after[i] = measured[i]->bytes.load();
+    uint64_t staleAfter = stale ? stale->bytes.load() : 0;
+
+    hub.stop();
+    for (auto& p : peers) p->stop();
+    srvThread.join();
+    for (auto& t : cliThreads) t.join();
+
+    bool ok = true;
+    double total = 0;
+    for (size_t i = 0; i < clients; ++i) {
+        double got = (after[i] - before[i]) / elapsed;
+        total += got;
+        bool pass = got >= expect[i] * (1 - tolerance) && got <= expect[i] * (1 + tolerance);
+        ok = ok && pass;
+        printf("[loopback] client %zu %s offered=%.0f expected=%.0f got=%.0f B/s %s\n",
+               i, i < light ? "light" : "heavy", offered[i], expect[i], got, pass ? "ok" : "FAIL");
+    }
+    if (stale) {
+        bool pass = staleAfter == staleBefore;
+        ok = ok && pass;
+        printf("[loopback] replaced session of client 0 got=%.0f B/s %s\n",
+               (staleAfter - staleBefore) / elapsed, pass ? "ok" : "FAIL");
+    }
+    printf("[loopback] total=%.0f B/s session-rate=%llu global-rate=%llu\n", total,
+           static_cast<unsigned long long>(shaper.sessionRate),
+           static_cast<unsigned long long>(shaper.globalRate));
+    printf("[loopback] %s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -14,11 +14,13 @@
 #include <atomic>
 #include <vector>
 #include <cstdio>
+#include <memory>
 
 #include <netinet/ip.h>   // iphdr
 #include <arpa/inet.h>    // inet_ntop
 
 static void log_ip_packet(const uint8_t* data, size_t len, const char* tag) {
+    if (!tls::packetLogging().load(std::memory_order_relaxed)) return;
     if (len < sizeof(iphdr)) {
         printf("[%s] short/non-ip len=%zu\n", tag, len);
         return;
@@ -43,6 +45,7 @@ static int tcp_connect(const std::string& host, int port) {
     if (connect(s, (sockaddr*)&a, sizeof(a)) < 0) {
         perror("connect"); close(s); return -1;
     }
+    setNoDelay(s);
     return s;
 }
 
@@ -52,6 +55,8 @@ Client::Client(ICipherStrategy* cs, IKeyStore* ks,
 : _cs(cs), _ks(ks), _host(host), _port(port), _tunName(tunName) {}
 
 bool Client::run() {
+    if (!_cs) return false;
+
     SSL_library_init();
     SSL_load_error_strings();
     OpenSSL_add_ssl_algorithms();
@@ -59,7 +64,7 @@ bool Client::run() {
     SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
     if (!ctx) { ERR_print_errors_fp(stderr); return false; }
 
-    if (!_cs || !_cs->configureContext(ctx)) {
+    if (!_cs->configureContext(ctx)) {
         SSL_CTX_free(ctx);
         return false;
     }
@@ -76,21 +81,33 @@ bool Client::run() {
     int s = tcp_connect(_host, _port);
     if (s < 0) { SSL_CTX_free(ctx); return false; }
 
-    // create SSL and make handshake
-    SSL* ssl = SSL_new(ctx);
-    if (!ssl) { ERR_print_errors_fp(stderr); close(s); SSL_CTX_free(ctx); return false; }
+    // create SSL and make handshake (NullCipher: plain TCP, no SSL object)
+    SSL* ssl = nullptr;
+    if (_cs->usesTls()) {
+        ssl = SSL_new(ctx);
+        if (!ssl) { ERR_print_errors_fp(stderr); close(s); SSL_CTX_free(ctx); return false; }
 
-    SSL_set_fd(ssl, s);
-    if (SSL_connect(ssl) <= 0) {
-        ERR_print_errors_fp(stderr);
-        SSL_free(ssl); close(s); SSL_CTX_free(ctx); return false;
-    }
+        SSL_set_fd(ssl, s);
+        if (SSL_connect(ssl) <= 0) {
+            ERR_print_errors_fp(stderr);
+            SSL_free(ssl); close(s); SSL_CTX_free(ctx); return false;
+        }
 
-    // --- ЛОГИ TLS ---
-    printf("[client] TLS connected\n");
-    printf("[client][TLS] version=%s cipher=%s\n", SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+        // --- ЛОГИ TLS ---
+        printf("[client] TLS connected\n");
+        printf("[client][TLS] version=%s cipher=%s\n", SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+    } else {
+        printf("[client] plaintext connected (null cipher)\n");
+    }
+    Channel ch(ssl, s);
 
-    Tun tun(_tunName);
+    std::unique_ptr<Tun> ownTun;
+    IPacketDevice* dev = _dev;
+    if (!dev) {
+        ownTun.reset(new Tun(_tunName));
+        dev = ownTun.get();
+    }
+    IPacketDevice& tun = *dev;
     printf("[client] TUN ready: %s\n", tun.ifname().c_str());
 
     std::atomic<bool> running{true};
@@ -101,11 +118,11 @@ bool Client::run() {
         while (running.load()) {
             ssize_t n = tun.readPacket(buf.data(), buf.size());
             if (n <= 0) {
-                perror("[client] read(TUN)");
+                if (n < 0) perror("[client] read(TUN)");
                 running = false; break;
             }
             log_ip_packet(buf.data(), (size_t)n, "C TUN->TLS");
-            if (!sendWithLength(ssl, buf.data(), (size_t)n)) {
+            if (!sendWithLength(ch, buf.data(), (size_t)n)) {
                 fprintf(stderr, "[client] sendWithLength failed\n");
                 running = false; break;
             }
@@ -116,7 +133,7 @@ bool Client::run() {
     std::thread t2([&]{
         std::string frame;
         while (running.load()) {
-            if (!receiveWithLength(ssl, frame)) {
+            if (!receiveWithLength(ch, frame)) {
                 fprintf(stderr, "[client] receiveWithLength failed\n");
                 running = false; break;
             }
@@ -128,11 +145,16 @@ bool Client::run() {
         }
     });
 
+    // TUN side is done: wake the TLS reader blocked in read(), keep the
+    // write half so SSL_shutdown below can still send close_notify
     t1.join();
+    shutdown(s, SHUT_RD);
     t2.join();
 
-    SSL_shutdown(ssl);
-    SSL_free(ssl);
+    if (ssl) {
+        SSL_shutdown(ssl);
+        SSL_free(ssl);
+    }
     close(s);
     SSL_CTX_free(ctx);
     return true;
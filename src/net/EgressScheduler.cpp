@@ -0,0 +1,147 @@
+#include "net/EgressScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace tls {
+
+static const uint64_t kMaxWaitNs = 100 * 1000 * 1000;
+
+EgressScheduler::EgressScheduler(const ShaperConfig& cfg)
+    : _cfg(cfg), _global(cfg.globalRate, cfg.globalBurst) {
+    if (_cfg.quantum == 0) _cfg.quantum = 1500;
+}
+
+void EgressScheduler::addSession(uint32_t id) {
+    std::lock_guard<std::mutex> lk(_mu);
+    Queue& q = _queues[id];
+    q.bucket = std::make_shared<TokenBucket>(_cfg.sessionRate, _cfg.sessionBurst);
+}
+
+void EgressScheduler::removeSession(uint32_t id) {
+    std::lock_guard<std::mutex> lk(_mu);
+    _queues.erase(id);
+    _active.erase(std::remove(_active.begin(), _active.end(), id), _active.end());
+}
+
+void EgressScheduler::setBlocked(uint32_t id, bool blocked) {
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        auto it = _queues.find(id);
+        if (it == _queues.end()) return;
+        it->second.blocked = blocked;
+    }
+    if (!blocked) _cv.notify_one();
+}
+
+bool EgressScheduler::enqueue(uint32_t id, const uint8_t* data, size_t len) {
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        auto it = _queues.find(id);
+        if (it == _queues.end()) return false;
+        Queue& q = it->second;
+        if (q.packets.size() >= _cfg.queueLimit) return false;
+        q.packets.emplace_back(data, data + len);
+        if (q.active) return true;
+        q.active = true;
+        _active.push_back(id);
+    }
+    _cv.notify_one();
+    return true;
+}
+
+void EgressScheduler::stop() {
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        _stopped = true;
+    }
+    _cv.notify_all();
+}
+
+bool EgressScheduler::next(uint32_t& id, std::vector<uint8_t>& pkt) {
+    std::unique_lock<std::mutex> lk(_mu);
+    for (;;) {
+        if (_stopped) return false;
+        if (_active.empty()) { _cv.wait(lk); continue; }
+
+        uint64_t wait = std::numeric_limits<uint64_t>::max();
+        bool globalBlocked = false;
+        bool rotated = false;
+        bool restart = false;
+
+        // at most one visit per active session, then sleep if nobody was eligible
+        for (size_t visits = _active.size(); visits > 0; --visits) {
+            uint32_t cur = _active.front();
+            Queue& q = _queues[cur];
+            if (q.blocked) {
+                // keeps its deficit, setBlocked(false) wakes us up
+                _active.pop_front(); _active.push_back(cur);
+                continue;
+            }
+            if (!q.inTurn) { q.deficit += _cfg.quantum; q.inTurn = true; }
+
+            size_t len = q.packets.front().size();
+            if (len > q.deficit) {
+                // turn is over, deficit carries to the next round
+                q.inTurn = false;
+                _active.pop_front(); _active.push_back(cur);
+                rotated = true;
+                continue;
+            }
+
+            // Buckets are checked with _mu released, so enqueue() from the TUN
+            // reader never waits behind refill/consume. Only this thread pops,
+            // the head packet stays where it is meanwhile.
+            std::shared_ptr<TokenBucket> bucket = q.bucket;
+            lk.unlock();
+            uint64_t now = TokenBucket::nowNs();
+            uint64_t bucketWait = 0;
+            bool sessionOk = bucket->tryConsume(len, now);
+            bool globalOk = false;
+            if (!sessionOk) {
+                bucketWait = bucket->waitNs(len, now);
+            } else if (!(globalOk = _global.tryConsume(len, now))) {
+                bucket->refund(len);
+                bucketWait = _global.waitNs(len, now);
+            }
+            lk.lock();
+
+            auto it = _queues.find(cur);
+            if (_stopped || it == _queues.end()) {
+                // stopped or session removed while unlocked
+                if (globalOk) { bucket->refund(len); _global.refund(len); }
+                restart = true;
+                break;
+            }
+            if (!sessionOk) {
+                wait = std::min(wait, bucketWait);
+                if (_active.front() == cur) { _active.pop_front(); _active.push_back(cur); }
+                continue;
+            }
+            if (!globalOk) {
+                wait = std::min(wait, bucketWait);
+                globalBlocked = true;
+                break;
+            }
+
+            Queue& sent = it->second;
+            id = cur;
+            pkt.swap(sent.packets.front());
+            sent.packets.pop_front();
+            sent.deficit -= len;
+            if (sent.packets.empty()) {
+                sent.deficit = 0;
+                sent.inTurn = false;
+                sent.active = false;
+                _active.erase(std::find(_active.begin(), _active.end(), cur));
+            }
+            return true;
+        }
+
+        if (restart) continue;
+        if (rotated && !globalBlocked) continue;
+        _cv.wait_for(lk, std::chrono::nanoseconds(std::min(wait, kMaxWaitNs)));
+    }
+}
+
+}
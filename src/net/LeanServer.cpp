@@ -0,0 +1,432 @@
+#include "net/Tun.h"
+#include "net/LeanServer.h"
+#include "net/Utils.h"
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+
+namespace tls {
+
+// frames carry IP packets, anything longer is a broken peer
+static const uint32_t kMaxFrame = 65535;
+static const size_t kTxQueueLimit = 256;
+static const int kDeviceBurst = 64;
+
+static char kListenTag;
+static char kDeviceTag;
+
+// Kept small on purpose, there may be tens of thousands of these.
+struct LeanServer::Session {
+    SSL* ssl = nullptr;
+    int fd;
+    uint32_t innerAddr = 0;         // pinned by the first IPv4 packet
+    uint32_t peerAddr = 0;          // outer IPv4 of the TCP peer
+    uint32_t rxLen = 0;             // payload length of the frame being read
+    uint32_t rxHave = 0;            // header + payload bytes read so far
+    uint32_t rxCap = 0;
+    uint32_t txOff = 0;             // bytes of tx->front() already written
+    uint8_t hdr[4];
+    bool handshaking = true;
+    bool wantWrite = false;         // EPOLLOUT armed
+    bool readWantsWrite = false;    // SSL_read asked for a writable socket
+    bool closed = false;            // deleted after the current epoll batch
+    std::unique_ptr<uint8_t[]> rx;  // only while a frame is half read
+    std::unique_ptr<std::deque<std::vector<uint8_t>>> tx;   // only while writes are backed up
+
+    explicit Session(int f) : fd(f) {}
+    ~Session() {
+        if (ssl) SSL_free(ssl);
+        close(fd);
+    }
+};
+
+enum IoResult { kIoOk, kIoBlocked, kIoClosed };
+
+// n > 0 bytes moved, otherwise why not
+static IoResult ioResult(SSL* ssl, int r, bool* wantsWrite) {
+    if (ssl) {
+        int err = SSL_get_error(ssl, r);
+        if (err == SSL_ERROR_WANT_READ) return kIoBlocked;
+        if (err == SSL_ERROR_WANT_WRITE) { if (wantsWrite) *wantsWrite = true; return kIoBlocked; }
+        if (err != SSL_ERROR_ZERO_RETURN && err != SSL_ERROR_SYSCALL) ERR_print_errors_fp(stderr);
+        ERR_clear_error();
+        return kIoClosed;
+    }
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return kIoBlocked;
+    return kIoClosed;
+}
+
+static int tcp_listen_nb(int port) {
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s < 0) { perror("socket"); return -1; }
+    int on = 1; setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in a{}; a.sin_family = AF_INET; a.sin_port = htons(port); a.sin_addr.s_addr = INADDR_ANY;
+    if (bind(s, (sockaddr*)&a, sizeof(a)) < 0) { perror("bind"); close(s); return -1; }
+    if (listen(s, SOMAXCONN) < 0) { perror("listen"); close(s); return -1; }
+    return s;
+}
+
+LeanServer::LeanServer(ICipherStrategy* cs, IKeyStore* ks, int port,
+                       const std::string& certFile, const std::string& keyFile,
+                       const std::string& tunName)
+: _cs(cs), _ks(ks), _port(port),
+  _certFile(certFile), _keyFile(keyFile), _tunName(tunName) {}
+
+LeanServer::~LeanServer() = default;
+
+SSL_CTX* LeanServer::makeContext() {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) { ERR_print_errors_fp(stderr); return nullptr; }
+    if (!_cs->configureContext(ctx)) { SSL_CTX_free(ctx); return nullptr; }
+
+    if (_cs->usesTls()) {
+        if (!_ks->loadKeyPair(ctx, _certFile, _keyFile)) { SSL_CTX_free(ctx); return nullptr; }
+    }
+    // idle sessions give their TLS record buffers back;
+    // partial/moving writes because frames are retried from our own queue
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS |
+                          SSL_MODE_ENABLE_PARTIAL_WRITE |
+                          SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    return ctx;
+}
+
+void LeanServer::refreshContext() {
+    uint64_t gen = _ks->generation();
+    SSL_CTX* next = makeContext();
+    _ctxGeneration = gen;
+    if (!next) {
+        fprintf(stderr, "[server] cannot build context for new key material, keeping current\n");
+        return;
+    }
+    SSL_CTX_free(_ctx);
+    _ctx = next;
+    printf("[server] key material generation %llu for new handshakes\n",
+           static_cast<unsigned long long>(gen));
+}
+
+bool LeanServer::run() {
+    SSL_library_init();
+    SSL_load_error_strings();
+    OpenSSL_add_ssl_algorithms();
+
+    _ctxGeneration = _ks->generation();
+    _ctx = makeContext();
+    if (!_ctx) return false;
+
+    _listenFd = tcp_listen_nb(_port);
+    if (_listenFd < 0) { SSL_CTX_free(_ctx); return false; }
+    printf("[server] listening on %d (lean)\n", _port);
+
+    _tun = _dev;
+    if (!_tun) {
+        _ownTun.reset(new Tun(_tunName));
+        _tun = _ownTun.get();
+    }
+    if (_tun->fd() < 0) {
+        fprintf(stderr, "[server] lean mode needs a pollable device\n");
+        close(_listenFd); SSL_CTX_free(_ctx); return false;
+    }
+    fcntl(_tun->fd(), F_SETFL, fcntl(_tun->fd(), F_GETFL) | O_NONBLOCK);
+    printf("[server] TUN ready: %s\n", _tun->ifname().c_str());
+
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epollFd < 0) { perror("epoll_create1"); close(_listenFd); SSL_CTX_free(_ctx); return false; }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &kListenTag;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _listenFd, &ev);
+    ev.data.ptr = &kDeviceTag;
+    epoll_ctl(_epollFd, EPOLL_CTL_ADD, _tun->fd(), &ev);
+
+    _scratch.resize(4 + kMaxFrame);
+    _running = true;
+
+    std::vector<epoll_event> events(256);
+    while (_running.load()) {
+        int n = epoll_wait(_epollFd, events.data(), static_cast<int>(events.size()), -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n && _running.load(); ++i) {
+            void* tag = events[i].data.ptr;
+            if (tag == &kListenTag)      acceptAll();
+            else if (tag == &kDeviceTag) deviceToSessions();
+            else onSessionEvent(static_cast<Session*>(tag), events[i].events);
+        }
+        // later events of the same batch may still point at them
+        for (Session* s : _closing) delete s;
+        _closing.clear();
+    }
+
+    _running = false;
+    for (Session* s : _sessions) delete s;
+    for (Session* s : _closing) delete s;
+    _sessions.clear();
+    _closing.clear();
+    _routes.clear();
+    close(_epollFd);
+    _epollFd = -1;
+    close(_listenFd);
+    _listenFd = -1;
+    _tun = nullptr;
+    _ownTun.reset();
+    std::vector<uint8_t>().swap(_scratch);
+    SSL_CTX_free(_ctx);
+    _ctx = nullptr;
+    return true;
+}
+
+void LeanServer::acceptAll() {
+    for (;;) {
+        sockaddr_in peer{};
+        socklen_t peerLen = sizeof(peer);
+        int fd = accept4(_listenFd, (sockaddr*)&peer, &peerLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                // out of descriptors: stop polling the listener (it would stay
+                // readable and spin) until some session goes away
+                perror("[server] accept");
+                setAcceptPaused(true);
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                perror("accept");
+            }
+            return;
+        }
+        if (_cs->usesTls() && _ks->generation() != _ctxGeneration) refreshContext();
+        // idle sessions are never written to, only keepalive finds dead ones
+        setDeadPeerTimeouts(fd);
+        setNoDelay(fd);
+
+        Session* s = new Session(fd);
+        s->peerAddr = peer.sin_addr.s_addr;
+        if (_cs->usesTls()) {
+            s->ssl = SSL_new(_ctx);
+            if (!s->ssl) { ERR_print_errors_fp(stderr); delete s; continue; }
+            SSL_set_fd(s->ssl, fd);
+            SSL_set_accept_state(s->ssl);
+        } else {
+            s->handshaking = false;
+        }
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("epoll_ctl"); delete s; continue;
+        }
+        _sessions.insert(s);
+    }
+}
+
+void LeanServer::setAcceptPaused(bool paused) {
+    if (_acceptPaused == paused) return;
+    _acceptPaused = paused;
+    epoll_event ev{};
+    ev.events = paused ? 0u : static_cast<uint32_t>(EPOLLIN);
+    ev.data.ptr = &kListenTag;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, _listenFd, &ev);
+}
+
+void LeanServer::setWantWrite(Session* s, bool on) {
+    if (s->wantWrite == on) return;
+    s->wantWrite = on;
+    epoll_event ev{};
+    ev.events = static_cast<uint32_t>(EPOLLIN) | (on ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    ev.data.ptr = s;
+    epoll_ctl(_epollFd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+void LeanServer::onSessionEvent(Session* s, uint32_t events) {
+    if (s->closed) return;
+    if (s->handshaking) {
+        handshake(s);
+        return;
+    }
+    if (events & EPOLLOUT) {
+        flushTx(s);
+        if (s->closed) return;
+        if (s->readWantsWrite) events |= EPOLLIN;
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readFrames(s);
+}
+
+void LeanServer::handshake(Session* s) {
+    int r = SSL_accept(s->ssl);
+    if (r == 1) {
+        s->handshaking = false;
+        setWantWrite(s, false);
+        if (packetLogging().load(std::memory_order_relaxed))
+            printf("[server] session fd=%d TLS accepted, %s\n", s->fd, SSL_get_cipher_name(s->ssl));
+        readFrames(s);      // the client may already have sent data
+        return;
+    }
+    bool wantsWrite = false;
+    if (ioResult(s->ssl, r, &wantsWrite) == kIoClosed) { closeSession(s); return; }
+    setWantWrite(s, wantsWrite);
+}
+
+void LeanServer::readFrames(Session* s) {
+    s->readWantsWrite = false;
+    for (;;) {
+        uint8_t* dst;
+        size_t want;
+        if (s->rxHave < 4) {
+            dst = s->hdr + s->rxHave;
+            want = 4 - s->rxHave;
+        } else {
+            dst = s->rx.get() + (s->rxHave - 4);
+            want = s->rxLen - (s->rxHave - 4);
+        }
+
+        int n = s->ssl ? SSL_read(s->ssl, dst, static_cast<int>(want))
+                       : static_cast<int>(recv(s->fd, dst, want, 0));
+        if (n <= 0) {
+            bool wantsWrite = false;
+            IoResult res = ioResult(s->ssl, n, &wantsWrite);
+            if (res == kIoClosed) { closeSession(s); return; }
+            if (wantsWrite) { s->readWantsWrite = true; setWantWrite(s, true); }
+            break;
+        }
+        s->rxHave += n;
+
+        if (s->rxHave == 4) {
+            uint32_t lenNet;
+            memcpy(&lenNet, s->hdr, 4);
+            s->rxLen = ntohl(lenNet);
+            if (s->rxLen > kMaxFrame) { closeSession(s); return; }
+            if (s->rxLen > s->rxCap) {
+                s->rx.reset(new uint8_t[s->rxLen]);
+                s->rxCap = s->rxLen;
+            }
+        }
+        if (s->rxHave >= 4 && s->rxHave == 4 + s->rxLen) {
+            deliver(s, s->rx.get(), s->rxLen);
+            s->rxHave = 0;
+        }
+    }
+
+    // idle between frames: give the payload buffer back
+    if (s->rxHave == 0 && s->rx) {
+        s->rx.reset();
+        s->rxCap = 0;
+    }
+}
+
+void LeanServer::deliver(Session* s, const uint8_t* pkt, size_t len) {
+    if (len == 0) return;
+    const iphdr* ip = reinterpret_cast<const iphdr*>(pkt);
+    if (len >= sizeof(iphdr) && ip->version == 4 && ip->saddr != s->innerAddr) {
+        // once pinned, drop it: a peer must not pull someone else's traffic
+        if (s->innerAddr) return;
+        auto owner = _routes.find(ip->saddr);
+        if (owner != _routes.end()) {
+            // reconnect from the same host: the old session is likely half-open
+            if (owner->second->peerAddr != s->peerAddr) return;
+            printf("[server] session fd=%d took over the address of fd=%d\n", s->fd, owner->second->fd);
+            closeSession(owner->second);
+        }
+        _routes[ip->saddr] = s;
+        s->innerAddr = ip->saddr;
+    }
+    if (_tun->writePacket(pkt, len) != (ssize_t)len && errno != EAGAIN)
+        perror("[server] write(TUN)");
+}
+
+void LeanServer::deviceToSessions() {
+    for (int i = 0; i < kDeviceBurst; ++i) {
+        // payload lands right after the header slot so the frame goes out in one write
+        ssize_t n = _tun->readPacket(_scratch.data() + 4, _scratch.size() - 4);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+        if (n <= 0) {
+            if (n < 0) perror("[server] read(TUN)");
+            _running = false;
+            return;
+        }
+
+        Session* s = nullptr;
+        const iphdr* ip = reinterpret_cast<const iphdr*>(_scratch.data() + 4);
+        if ((size_t)n >= sizeof(iphdr) && ip->version == 4) {
+            auto r = _routes.find(ip->daddr);
+            if (r != _routes.end()) s = r->second;
+        }
+        // single peer: behave like a point-to-point link
+        if (!s && _sessions.size() == 1 && !(*_sessions.begin())->handshaking)
+            s = *_sessions.begin();
+        if (!s) continue;
+
+        uint32_t lenNet = htonl(static_cast<uint32_t>(n));
+        memcpy(_scratch.data(), &lenNet, 4);
+        sendFrame(s, _scratch.data(), 4 + (size_t)n);
+    }
+}
+
+void LeanServer::sendFrame(Session* s, uint8_t* frame, size_t len) {
+    if (s->tx) {
+        if (s->tx->size() >= kTxQueueLimit) return;          // tail drop
+        s->tx->emplace_back(frame, frame + len);
+        return;
+    }
+
+    size_t off = 0;
+    while (off < len) {
+        int n = s->ssl ? SSL_write(s->ssl, frame + off, static_cast<int>(len - off))
+                       : static_cast<int>(send(s->fd, frame + off, len - off, MSG_NOSIGNAL));
+        if (n <= 0) {
+            if (ioResult(s->ssl, n, nullptr) == kIoClosed) { closeSession(s); return; }
+            break;
+        }
+        off += n;
+    }
+    if (off == len) return;
+
+    s->tx.reset(new std::deque<std::vector<uint8_t>>());
+    s->tx->emplace_back(frame + off, frame + len);
+    s->txOff = 0;
+    setWantWrite(s, true);
+}
+
+void LeanServer::flushTx(Session* s) {
+    while (s->tx && !s->tx->empty()) {
+        std::vector<uint8_t>& f = s->tx->front();
+        int n = s->ssl ? SSL_write(s->ssl, f.data() + s->txOff, static_cast<int>(f.size() - s->txOff))
+                       : static_cast<int>(send(s->fd, f.data() + s->txOff, f.size() - s->txOff, MSG_NOSIGNAL));
+        if (n <= 0) {
+            if (ioResult(s->ssl, n, nullptr) == kIoClosed) closeSession(s);
+            return;
+        }
+        s->txOff += n;
+        if (s->txOff == f.size()) {
+            s->tx->pop_front();
+            s->txOff = 0;
+        }
+    }
+    s->tx.reset();
+    if (!s->readWantsWrite) setWantWrite(s, false);
+}
+
+void LeanServer::closeSession(Session* s) {
+    if (s->closed) return;
+    s->closed = true;
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, s->fd, nullptr);
+    auto r = _routes.find(s->innerAddr);
+    if (r != _routes.end() && r->second == s) _routes.erase(r);
+    _sessions.erase(s);
+    if (packetLogging().load(std::memory_order_relaxed))
+        printf("[server] session fd=%d closed\n", s->fd);
+    _closing.push_back(s);
+    setAcceptPaused(false);
+}
+
+}
@@ -11,13 +11,17 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <thread>
+#include <chrono>
 #include <atomic>
 #include <vector>
+#include <deque>
 #include <cstdio>
+#include <cerrno>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
 
 static void log_ip_packet(const uint8_t* data, size_t len, const char* tag) {
+    if (!tls::packetLogging().load(std::memory_order_relaxed)) return;
     if (len < sizeof(iphdr)) {
         printf("[%s] short/non-ip len=%zu\n", tag, len);
         return;
@@ -38,79 +42,343 @@ static int tcp_listen(int port) {
     int on = 1; setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
     sockaddr_in a{}; a.sin_family = AF_INET; a.sin_port = htons(port); a.sin_addr.s_addr = INADDR_ANY;
     if (bind(s, (sockaddr*)&a, sizeof(a)) < 0) { perror("bind"); close(s); return -1; }
-    if (listen(s, 8) < 0) { perror("listen"); close(s); return -1; }
+    if (listen(s, SOMAXCONN) < 0) { perror("listen"); close(s); return -1; }
     return s;
 }
 
+// frames handed to a session writer before the scheduler stops serving it
+static const size_t kOutboxLimit = 8;
+
+struct Server::Session {
+    uint32_t id;
+    int fd;
+    SSL* ssl = nullptr;
+    Channel ch;
+    uint32_t innerAddr = 0;     // pinned by the first IPv4 packet, 0 until then
+    uint32_t peerAddr = 0;      // outer IPv4 of the TCP peer (net order)
+
+    // egress thread -> session writer; a slow peer only stalls its own writer
+    std::mutex outMu;
+    std::condition_variable outCv;
+    std::deque<std::vector<uint8_t>> outbox;
+    bool blocked = false;       // outbox full, EgressScheduler skips this session
+    bool closing = false;
+
+    Session(uint32_t i, int f) : id(i), fd(f), ch(nullptr, f) {}
+    ~Session() {
+        if (ssl) SSL_free(ssl);
+        close(fd);
+    }
+};
+
 Server::Server(ICipherStrategy* cs, IKeyStore* ks, int port,
                const std::string& certFile, const std::string& keyFile,
-               const std::string& tunName)
+               const std::string& tunName, const ShaperConfig& shaper)
 : _cs(cs), _ks(ks), _port(port),
-  _certFile(certFile), _keyFile(keyFile), _tunName(tunName) {}
+  _certFile(certFile), _keyFile(keyFile), _tunName(tunName), _sched(shaper) {}
+
+Server::~Server() = default;
 
 bool Server::run() {
     SSL_library_init();
     SSL_load_error_strings();
     OpenSSL_add_ssl_algorithms();
 
-    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
-    if (!_cs->configureContext(ctx)) { SSL_CTX_free(ctx); return false; }
-
-    if (!_ks->loadCertificate(ctx, _certFile)) { SSL_CTX_free(ctx); return false; }
-    if (!_ks->loadPrivateKey(ctx, _keyFile))   { SSL_CTX_free(ctx); return false; }
+    _ctxGeneration = _ks->generation();
+    _ctx = makeContext();
+    if (!_ctx) return false;
 
-    int ls = tcp_listen(_port);
-    if (ls < 0) { SSL_CTX_free(ctx); return false; }
+    _listenFd = tcp_listen(_port);
+    if (_listenFd < 0) { SSL_CTX_free(_ctx); return false; }
     printf("[server] listening on %d\n", _port);
 
-    int cs = accept(ls, nullptr, nullptr);
-    if (cs < 0) { perror("accept"); close(ls); SSL_CTX_free(ctx); return false; }
+    _tun = _dev;
+    if (!_tun) {
+        _ownTun.reset(new Tun(_tunName));
+        _tun = _ownTun.get();
+    }
+    printf("[server] TUN ready: %s\n", _tun->ifname().c_str());
+
+    _running = true;
+    std::thread tunThread(&Server::tunToSessions, this);
+    std::thread egressThread(&Server::egressLoop, this);
+
+    bool starved = false;
+    while (_running.load()) {
+        sockaddr_in peer{};
+        socklen_t peerLen = sizeof(peer);
+        int cs = accept(_listenFd, (sockaddr*)&peer, &peerLen);
+        if (cs < 0) {
+            if (!_running.load()) break;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // the pending connection stays queued, retrying at once would
+                // spin; give closing sessions time to release their fds
+                if (!starved) perror("[server] accept, backing off");
+                starved = true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            if (errno != EINTR && errno != ECONNABORTED) perror("accept");
+            continue;
+        }
+        if (starved) fprintf(stderr, "[server] accepting again\n");
+        starved = false;
+        if (_cs->usesTls() && _ks->generation() != _ctxGeneration) refreshContext();
+        setDeadPeerTimeouts(cs);
+        setNoDelay(cs);
+
+        std::shared_ptr<Session> s;
+        {
+            std::lock_guard<std::mutex> lk(_mu);
+            s = std::make_shared<Session>(_nextId++, cs);
+            s->peerAddr = peer.sin_addr.s_addr;
+            _liveFds[s->id] = cs;
+            ++_liveThreads;
+        }
+        // the SSL holds its own reference to _ctx, so a later swap does not touch it
+        if (_cs->usesTls()) {
+            s->ssl = SSL_new(_ctx);
+            if (s->ssl) SSL_set_fd(s->ssl, cs);
+        }
+        std::thread(&Server::serveSession, this, s).detach();
+    }
+
+    // TUN is gone: stop egress, kick every session off its socket and wait
+    _sched.stop();
+    egressThread.join();
+    tunThread.join();
+    {
+        std::unique_lock<std::mutex> lk(_mu);
+        for (auto& kv : _liveFds) shutdown(kv.second, SHUT_RDWR);
+        _threadsDone.wait(lk, [this] { return _liveThreads == 0; });
+        _sessions.clear();
+        _routes.clear();
+    }
+
+    close(_listenFd);
+    _listenFd = -1;
+    _tun = nullptr;
+    _ownTun.reset();
+    SSL_CTX_free(_ctx);
+    _ctx = nullptr;
+    return true;
+}
 
-    SSL* ssl = SSL_new(ctx);
-    SSL_set_fd(ssl, cs);
-    if (SSL_accept(ssl) <= 0) {
-        ERR_print_errors_fp(stderr);
-        SSL_free(ssl); close(cs); close(ls); SSL_CTX_free(ctx); return false;
+SSL_CTX* Server::makeContext() {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) { ERR_print_errors_fp(stderr); return nullptr; }
+    if (!_cs->configureContext(ctx)) { SSL_CTX_free(ctx); return nullptr; }
+
+    if (_cs->usesTls()) {
+        if (!_ks->loadKeyPair(ctx, _certFile, _keyFile)) { SSL_CTX_free(ctx); return nullptr; }
     }
+    return ctx;
+}
 
-    printf("[server] TLS accepted\n");
-    printf("[server][TLS] version=%s cipher=%s\n", SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+void Server::refreshContext() {
+    uint64_t gen = _ks->generation();
+    SSL_CTX* next = makeContext();
+    if (!next) {
+        fprintf(stderr, "[server] cannot build context for new key material, keeping current\n");
+        _ctxGeneration = gen;
+        return;
+    }
+    // running sessions keep the old context alive through their SSL objects
+    SSL_CTX_free(_ctx);
+    _ctx = next;
+    _ctxGeneration = gen;
+    printf("[server] key material generation %llu for new handshakes\n",
+           static_cast<unsigned long long>(gen));
+}
+
+void Server::serveSession(std::shared_ptr<Session> s) {
+    bool ok = true;
+    if (_cs->usesTls()) {
+        if (!s->ssl || SSL_accept(s->ssl) <= 0) {
+            ERR_print_errors_fp(stderr);
+            ok = false;
+        } else if (packetLogging().load(std::memory_order_relaxed)) {
+            printf("[server] session %u TLS accepted\n", s->id);
+            printf("[server][TLS] version=%s cipher=%s\n", SSL_get_version(s->ssl), SSL_get_cipher_name(s->ssl));
+        }
+        s->ch = Channel(s->ssl, s->fd);
+    } else if (packetLogging().load(std::memory_order_relaxed)) {
+        printf("[server] session %u plaintext accepted (null cipher)\n", s->id);
+    }
 
-    Tun tun(_tunName);
-    printf("[server] TUN ready: %s\n", tun.ifname().c_str());
+    if (ok) {
+        std::lock_guard<std::mutex> lk(_mu);
+        if (_running.load()) {
+            _sessions[s->id] = s;
+            _sched.addSession(s->id);
+        } else {
+            ok = false;
+        }
+    }
 
-    std::atomic<bool> running{true};
+    std::thread writer;
+    if (ok) writer = std::thread(&Server::sessionWriter, this, s);
 
-    std::thread t1([&] {
-        std::string frame;
-        while (running.load()) {
-            if (!receiveWithLength(ssl, frame)) {
-                fprintf(stderr, "[server] recv fail\n"); running=false; break;
+    std::string frame;
+    while (ok) {
+        if (!receiveWithLength(s->ch, frame)) {
+            if (packetLogging().load(std::memory_order_relaxed))
+                fprintf(stderr, "[server] session %u recv fail\n", s->id);
+            break;
+        }
+        const uint8_t* pkt = reinterpret_cast<const uint8_t*>(frame.data());
+        log_ip_packet(pkt, frame.size(), "S TLS->TUN");
+
+        // the first IPv4 source pins the session's inner address; anything
+        // else from this peer would let it steal another session's route
+        const iphdr* ip = reinterpret_cast<const iphdr*>(pkt);
+        if (frame.size() >= sizeof(iphdr) && ip->version == 4 && ip->saddr != s->innerAddr) {
+            if ((s->innerAddr || !bindInnerAddr(*s, ip->saddr)) && _sourceCheck) {
+                log_ip_packet(pkt, frame.size(), "S spoofed drop");
+                continue;
             }
-            log_ip_packet(reinterpret_cast<const uint8_t*>(frame.data()), frame.size(), "S TLS->TUN");
-            if (tun.writePacket(reinterpret_cast<const uint8_t*>(frame.data()), frame.size()) != (ssize_t)frame.size()) {
-                perror("[server] write(TUN)"); running=false; break;
+        }
+        if (_tun->writePacket(pkt, frame.size()) != (ssize_t)frame.size()) {
+            perror("[server] write(TUN)"); break;
+        }
+    }
+
+    dropSession(s->id);
+    {
+        std::lock_guard<std::mutex> lk(s->outMu);
+        s->closing = true;
+    }
+    s->outCv.notify_one();
+    if (writer.joinable()) writer.join();
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        _liveFds.erase(s->id);
+    }
+    s.reset();
+    std::lock_guard<std::mutex> lk(_mu);
+    if (--_liveThreads == 0) _threadsDone.notify_all();
+}
+
+void Server::sessionWriter(std::shared_ptr<Session> s) {
+    std::vector<uint8_t> pkt;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(s->outMu);
+            s->outCv.wait(lk, [&] { return s->closing || !s->outbox.empty(); });
+            if (s->closing) return;
+            pkt.swap(s->outbox.front());
+            s->outbox.pop_front();
+            if (s->blocked && s->outbox.size() < kOutboxLimit) {
+                s->blocked = false;
+                _sched.setBlocked(s->id, false);
             }
         }
-    });
-
-    std::thread t2([&] {
-        std::vector<uint8_t> buf(20000);
-        while (running.load()) {
-            ssize_t n = tun.readPacket(buf.data(), buf.size());
-            if (n <= 0) { perror("[server] read(TUN)"); running=false; break; }
-            log_ip_packet(buf.data(), (size_t)n, "S TUN->TLS");
-            if (!sendWithLength(ssl, buf.data(), (size_t)n)) { fprintf(stderr, "[server] send fail\n"); running=false; break; }
+        if (!sendWithLength(s->ch, pkt.data(), pkt.size())) {
+            fprintf(stderr, "[server] session %u send fail\n", s->id);
+            shutdown(s->fd, SHUT_RDWR);     // the reader sees it and drops the session
+            return;
         }
-    });
-
-    t1.join(); t2.join();
-    SSL_shutdown(ssl);
-    SSL_free(ssl);
-    close(cs);
-    close(ls);
-    SSL_CTX_free(ctx);
+    }
+}
+
+bool Server::bindInnerAddr(Session& s, uint32_t addr) {
+    uint32_t stale = 0;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        auto r = _routes.find(addr);
+        if (r != _routes.end() && r->second != s.id) {
+            // a client that reconnects from the same host takes its address
+            // back at once; the old session is most likely half-open. Other
+            // hosts wait until the owner goes away (keepalive closes dead ones).
+            auto owner = _sessions.find(r->second);
+            if (owner == _sessions.end() || owner->second->peerAddr != s.peerAddr) {
+                if (packetLogging().load(std::memory_order_relaxed)) {
+                    char a[INET_ADDRSTRLEN];
+                    in_addr in{addr};
+                    inet_ntop(AF_INET, &in, a, sizeof(a));
+                    fprintf(stderr, "[server] session %u: %s is bound to session %u\n", s.id, a, r->second);
+                }
+                return false;
+            }
+            stale = r->second;
+        }
+        _routes[addr] = s.id;
+        s.innerAddr = addr;
+    }
+    if (stale) {
+        printf("[server] session %u took over the address of session %u\n", s.id, stale);
+        dropSession(stale);
+    }
     return true;
 }
 
+void Server::dropSession(uint32_t id) {
+    std::shared_ptr<Session> s;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        auto it = _sessions.find(id);
+        if (it == _sessions.end()) return;
+        s = it->second;
+        _sessions.erase(it);
+        auto r = _routes.find(s->innerAddr);
+        if (r != _routes.end() && r->second == id) _routes.erase(r);
+    }
+    _sched.removeSession(id);
+    shutdown(s->fd, SHUT_RDWR);
+    if (packetLogging().load(std::memory_order_relaxed))
+        printf("[server] session %u closed\n", id);
+}
+
+void Server::tunToSessions() {
+    std::vector<uint8_t> buf(20000);
+    while (_running.load()) {
+        ssize_t n = _tun->readPacket(buf.data(), buf.size());
+        if (n <= 0) { if (n < 0) perror("[server] read(TUN)"); break; }
+        log_ip_packet(buf.data(), (size_t)n, "S TUN->TLS");
+
+        uint32_t id = 0;
+        {
+            std::lock_guard<std::mutex> lk(_mu);
+            const iphdr* ip = reinterpret_cast<const iphdr*>(buf.data());
+            if ((size_t)n >= sizeof(iphdr) && ip->version == 4) {
+                auto r = _routes.find(ip->daddr);
+                if (r != _routes.end()) id = r->second;
+            }
+            // single peer: behave like a point-to-point link
+            if (!id && _sessions.size() == 1) id = _sessions.begin()->first;
+        }
+        if (!id || !_sched.enqueue(id, buf.data(), (size_t)n)) {
+            log_ip_packet(buf.data(), (size_t)n, "S drop");
+        }
+    }
+
+    _running = false;
+    shutdown(_listenFd, SHUT_RDWR);   // unblocks accept()
+}
+
+void Server::egressLoop() {
+    uint32_t id;
+    std::vector<uint8_t> pkt;
+    while (_sched.next(id, pkt)) {
+        std::shared_ptr<Session> s;
+        {
+            std::lock_guard<std::mutex> lk(_mu);
+            auto it = _sessions.find(id);
+            if (it != _sessions.end()) s = it->second;
+        }
+        if (!s) continue;
+
+        // never write here: a peer that stopped reading would stall everyone
+        std::lock_guard<std::mutex> lk(s->outMu);
+        if (s->closing) continue;
+        s->outbox.push_back(std::move(pkt));
+        pkt.clear();
+        if (s->outbox.size() >= kOutboxLimit && !s->blocked) {
+            s->blocked = true;
+            _sched.setBlocked(id, true);
+        }
+        s->outCv.notify_one();
+    }
+}
+
 }
@@ -0,0 +1,87 @@
+#include "net/TokenBucket.h"
+#include <algorithm>
+#include <chrono>
+
+namespace tls {
+
+// a single frame must always fit into the bucket, otherwise it would stall forever
+static const uint64_t kMinBurst = 65536;
+static const uint64_t kNsPerSec = 1000000000ULL;
+
+TokenBucket::TokenBucket(uint64_t rateBytesPerSec, uint64_t burstBytes) {
+    configure(rateBytesPerSec, burstBytes);
+}
+
+void TokenBucket::configure(uint64_t rateBytesPerSec, uint64_t burstBytes) {
+    _rate  = rateBytesPerSec;
+    _burst = std::max(burstBytes, kMinBurst);
+    _fillNs = _rate ? (_burst * kNsPerSec) / _rate : 0;
+    _tokens.store(static_cast<int64_t>(_burst));
+    _lastNs.store(nowNs());
+}
+
+uint64_t TokenBucket::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TokenBucket::refill(uint64_t now) {
+    uint64_t last = _lastNs.load(std::memory_order_acquire);
+    for (;;) {
+        if (now <= last) return;
+        uint64_t elapsed = now - last;
+        uint64_t add, credited;
+        if (elapsed >= _fillNs) {
+            add = _burst;
+            credited = elapsed;
+        } else {
+            add = elapsed * _rate / kNsPerSec;
+            if (add == 0) return;                       // keep the fraction for later
+            credited = add * kNsPerSec / _rate;         // only the time we paid for
+        }
+        // whoever wins the CAS on the timestamp owns this slice of tokens
+        if (!_lastNs.compare_exchange_weak(last, last + credited,
+                                           std::memory_order_acq_rel))
+            continue;
+
+        int64_t cur = _tokens.load(std::memory_order_relaxed);
+        int64_t next;
+        do {
+            next = std::min<int64_t>(cur + static_cast<int64_t>(add),
+                                     static_cast<int64_t>(_burst));
+        } while (!_tokens.compare_exchange_weak(cur, next, std::memory_order_acq_rel));
+        return;
+    }
+}
+
+bool TokenBucket::tryConsume(uint64_t bytes, uint64_t now) {
+    if (unlimited()) return true;
+    refill(now);
+    int64_t need = static_cast<int64_t>(std::min(bytes, _burst));
+    int64_t cur = _tokens.load(std::memory_order_relaxed);
+    do {
+        if (cur < need) return false;
+    } while (!_tokens.compare_exchange_weak(cur, cur - need, std::memory_order_acq_rel));
+    return true;
+}
+
+void TokenBucket::refund(uint64_t bytes) {
+    if (unlimited()) return;
+    int64_t back = static_cast<int64_t>(std::min(bytes, _burst));
+    int64_t cur = _tokens.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+        next = std::min<int64_t>(cur + back, static_cast<int64_t>(_burst));
+    } while (!_tokens.compare_exchange_weak(cur, next, std::memory_order_acq_rel));
+}
+
+uint64_t TokenBucket::waitNs(uint64_t bytes, uint64_t now) {
+    if (unlimited()) return 0;
+    refill(now);
+    int64_t need = static_cast<int64_t>(std::min(bytes, _burst));
+    int64_t have = _tokens.load(std::memory_order_relaxed);
+    if (have >= need) return 0;
+    return (static_cast<uint64_t>(need - have) * kNsPerSec + _rate - 1) / _rate;
+}
+
+}
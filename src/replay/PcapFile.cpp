@@ -0,0 +1,204 @@
+#include "replay/PcapFile.h"
+#include <fstream>
+#include <iterator>
+
+namespace tls {
+
+namespace {
+
+const uint32_t kPcapMagicUs = 0xa1b2c3d4;
+const uint32_t kPcapMagicNs = 0xa1b23c4d;
+const uint32_t kNgSectionHeader = 0x0a0d0d0a;
+const uint32_t kNgByteOrderMagic = 0x1a2b3c4d;
+const uint32_t kNgInterfaceDesc = 1;
+const uint32_t kNgObsoletePacket = 2;
+const uint32_t kNgSimplePacket = 3;
+const uint32_t kNgEnhancedPacket = 6;
+
+uint16_t bswap16(uint16_t v) { return static_cast<uint16_t>((v >> 8) | (v << 8)); }
+uint32_t bswap32(uint32_t v) {
+    return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+}
+
+// assembles little-endian values byte by byte, so any host works;
+// `swap` is set for big-endian files
+struct Reader {
+    const uint8_t* p;
+    bool swap;
+    uint16_t u16(size_t off) const {
+        uint16_t v = static_cast<uint16_t>(p[off] | (p[off + 1] << 8));
+        return swap ? bswap16(v) : v;
+    }
+    uint32_t u32(size_t off) const {
+        uint32_t v = p[off] | (p[off + 1] << 8) | (p[off + 2] << 16) | (uint32_t(p[off + 3]) << 24);
+        return swap ? bswap32(v) : v;
+    }
+};
+
+uint16_t be16(const uint8_t* p) { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+
+uint64_t toNs(uint64_t ts, uint64_t unitsPerSec) {
+    const uint64_t ns = 1000000000ULL;
+    if (unitsPerSec <= ns && ns % unitsPerSec == 0) return ts * (ns / unitsPerSec);
+    return (ts / unitsPerSec) * ns + (ts % unitsPerSec) * ns / unitsPerSec;
+}
+
+}
+
+bool PcapFile::load(const std::string& path) {
+    _packets.clear();
+    _skipped = 0;
+    _error.clear();
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return fail("cannot open " + path);
+    std::vector<uint8_t> f((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (f.size() < 4) return fail("file too short");
+
+    Reader r{f.data(), false};
+    uint32_t magic = r.u32(0);
+    if (magic == kNgSectionHeader) return parsePcapng(f);
+    return parsePcap(f);
+}
+
+bool PcapFile::parsePcap(const std::vector<uint8_t>& f) {
+    if (f.size() < 24) return fail("truncated pcap header");
+    Reader r{f.data(), false};
+    uint32_t magic = r.u32(0);
+    bool nanos;
+    if (magic == kPcapMagicUs || magic == kPcapMagicNs) {
+        nanos = magic == kPcapMagicNs;
+    } else if (bswap32(magic) == kPcapMagicUs || bswap32(magic) == kPcapMagicNs) {
+        r.swap = true;
+        nanos = bswap32(magic) == kPcapMagicNs;
+    } else {
+        return fail("not a pcap/pcapng file");
+    }
+    uint32_t linkType = r.u32(20);
+
+    size_t off = 24;
+    while (off + 16 <= f.size()) {
+        uint64_t sec  = r.u32(off);
+        uint64_t frac = r.u32(off + 4);
+        uint32_t incl = r.u32(off + 8);
+        uint32_t orig = r.u32(off + 12);
+        off += 16;
+        if (incl > f.size() - off) return fail("truncated pcap record");
+        uint64_t ts = sec * 1000000000ULL + (nanos ? frac : frac * 1000);
+        if (incl < orig) ++_skipped;
+        else addFrame(linkType, ts, f.data() + off, incl);
+        off += incl;
+    }
+    return true;
+}
+
+bool PcapFile::parsePcapng(const std::vector<uint8_t>& f) {
+    struct Iface { uint32_t linkType; uint64_t unitsPerSec; };
+    std::vector<Iface> ifaces;
+    Reader r{f.data(), false};
+
+    size_t off = 0;
+    while (off + 12 <= f.size()) {
+        uint32_t type = r.u32(off);
+        if (type == kNgSectionHeader) {
+            if (off + 28 > f.size()) return fail("truncated pcapng section header");
+            uint32_t bom = Reader{f.data(), false}.u32(off + 8);
+            if (bom == kNgByteOrderMagic) r.swap = false;
+            else if (bswap32(bom) == kNgByteOrderMagic) r.swap = true;
+            else return fail("bad pcapng byte-order magic");
+            ifaces.clear();
+        }
+        uint32_t blockLen = r.u32(off + 4);
+        if (blockLen < 12 || blockLen % 4 || blockLen > f.size() - off)
+            return fail("bad pcapng block length");
+        const uint8_t* body = f.data() + off + 8;
+        size_t bodyLen = blockLen - 12;
+        Reader b{body, r.swap};
+
+        if (type == kNgInterfaceDesc && bodyLen >= 8) {
+            Iface ifc{b.u16(0), 1000000};
+            for (size_t o = 8; o + 4 <= bodyLen;) {
+                uint16_t code = b.u16(o), len = b.u16(o + 2);
+                if (code == 0 || o + 4 + len > bodyLen) break;
+                if (code == 9 && len >= 1) {                       // if_tsresol
+                    uint8_t v = body[o + 4];
+                    uint64_t units = 1;
+                    for (int i = 0; i < (v & 0x7f) && units < 1000000000000000000ULL; ++i)
+                        units *= (v & 0x80) ? 2 : 10;
+                    ifc.unitsPerSec = units;
+                }
+                o += 4 + ((len + 3u) & ~3u);
+            }
+            ifaces.push_back(ifc);
+        } else if (type == kNgEnhancedPacket && bodyLen >= 20) {
+            uint32_t ifId = b.u32(0);
+            uint64_t ts = (uint64_t(b.u32(4)) << 32) | b.u32(8);
+            uint32_t cap = b.u32(12), orig = b.u32(16);
+            if (ifId >= ifaces.size() || cap > bodyLen - 20) return fail("bad enhanced packet block");
+            if (cap < orig) ++_skipped;
+            else addFrame(ifaces[ifId].linkType, toNs(ts, ifaces[ifId].unitsPerSec), body + 20, cap);
+        } else if (type == kNgObsoletePacket && bodyLen >= 20) {
+            uint32_t ifId = b.u16(0);
+            uint64_t ts = (uint64_t(b.u32(4)) << 32) | b.u32(8);
+            uint32_t cap = b.u32(12), orig = b.u32(16);
+            if (ifId >= ifaces.size() || cap > bodyLen - 20) return fail("bad packet block");
+            if (cap < orig) ++_skipped;
+            else addFrame(ifaces[ifId].linkType, toNs(ts, ifaces[ifId].unitsPerSec), body + 20, cap);
+        } else if (type == kNgSimplePacket && bodyLen >= 4) {
+            uint32_t orig = b.u32(0);
+            if (ifaces.empty()) return fail("simple packet block before interface");
+            if (orig > bodyLen - 4) ++_skipped;               // snapped by the capture
+            else addFrame(ifaces[0].linkType, 0, body + 4, orig);
+        }
+        off += blockLen;
+    }
+    return true;
+}
+
+void PcapFile::addFrame(uint32_t linkType, uint64_t tsNs, const uint8_t* p, size_t len) {
+    size_t hdr = 0;
+    switch (linkType) {
+        case 12: case 14: case 101: case 228: case 229:     // raw IP
+            break;
+        case 0: case 108:                                   // BSD loopback
+            hdr = 4;
+            break;
+        case 1: {                                           // Ethernet
+            hdr = 14;
+            if (len < hdr) { ++_skipped; return; }
+            uint16_t et = be16(p + 12);
+            while ((et == 0x8100 || et == 0x88a8) && len >= hdr + 4) {
+                et = be16(p + hdr + 2);
+                hdr += 4;
+            }
+            if (et != 0x0800 && et != 0x86dd) { ++_skipped; return; }
+            break;
+        }
+        case 113:                                           // Linux cooked
+            hdr = 16;
+            break;
+        case 276:                                           // Linux cooked v2
+            hdr = 20;
+            break;
+        default:
+            ++_skipped;
+            return;
+    }
+    if (len <= hdr) { ++_skipped; return; }
+    p += hdr; len -= hdr;
+
+    // keep IP only, drop link-layer padding past the IP length
+    uint8_t ver = p[0] >> 4;
+    size_t ipLen;
+    if (ver == 4 && len >= 20)      ipLen = be16(p + 2);
+    else if (ver == 6 && len >= 40) ipLen = 40 + be16(p + 4);
+    else { ++_skipped; return; }
+    if (ipLen > len || ipLen == 0) { ++_skipped; return; }
+
+    PcapPacket pkt;
+    pkt.tsNs = tsNs;
+    pkt.data.assign(p, p + ipLen);
+    _packets.push_back(std::move(pkt));
+}
+
+}
@@ -0,0 +1,114 @@
+#include "replay/ReplayDevices.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace tls {
+
+// how far ahead of the expected packet a returning one is searched for
+static const size_t kMatchScan = 4096;
+
+ssize_t EchoDevice::readPacket(uint8_t* buf, size_t cap) {
+    std::unique_lock<std::mutex> lk(_mu);
+    _cv.wait(lk, [this] { return _closed || !_queue.empty(); });
+    if (_queue.empty()) return 0;
+    std::vector<uint8_t> pkt;
+    pkt.swap(_queue.front());
+    _queue.pop_front();
+    lk.unlock();
+
+    size_t n = std::min(cap, pkt.size());
+    memcpy(buf, pkt.data(), n);
+    return static_cast<ssize_t>(n);
+}
+
+ssize_t EchoDevice::writePacket(const uint8_t* buf, size_t len) {
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        if (_closed) return -1;
+        _queue.emplace_back(buf, buf + len);
+    }
+    _cv.notify_one();
+    return static_cast<ssize_t>(len);
+}
+
+void EchoDevice::close() {
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        _closed = true;
+    }
+    _cv.notify_all();
+}
+
+ReplaySource::ReplaySource(const std::vector<PcapPacket>& packets, bool originalTiming,
+                           size_t window, std::chrono::milliseconds drain)
+    : _packets(packets), _originalTiming(originalTiming),
+      _window(std::max<size_t>(window, 1)), _drain(drain), _sentAt(packets.size()) {}
+
+ssize_t ReplaySource::readPacket(uint8_t* buf, size_t cap) {
+    std::unique_lock<std::mutex> lk(_mu);
+
+    if (_next == _packets.size()) {
+        // everything is out: wait for the tail to come back, then end the tunnel
+        _cv.wait_for(lk, _drain, [this] { return _matchPos == _next; });
+        return 0;
+    }
+
+    // bounded in-flight window so a fast replay does not overrun server queues;
+    // a stalled window is given up on after the drain timeout
+    _cv.wait_for(lk, _drain, [this] { return _next - _matchPos < _window; });
+
+    const PcapPacket& p = _packets[_next];
+    if (_next == 0) {
+        _start = Clock::now();
+    } else if (_originalTiming && p.tsNs > _packets[0].tsNs) {
+        Clock::time_point due = _start + std::chrono::nanoseconds(p.tsNs - _packets[0].tsNs);
+        lk.unlock();
+        std::this_thread::sleep_until(due);
+        lk.lock();
+    }
+
+    size_t n = std::min(cap, p.data.size());
+    memcpy(buf, p.data.data(), n);
+    _sentAt[_next] = Clock::now();
+    ++_next;
+    ++_rep.sent;
+    return static_cast<ssize_t>(n);
+}
+
+ssize_t ReplaySource::writePacket(const uint8_t* buf, size_t len) {
+    Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        size_t end = std::min(_next, _matchPos + kMatchScan);
+        size_t j = _matchPos;
+        for (; j < end; ++j) {
+            const std::vector<uint8_t>& d = _packets[j].data;
+            if (d.size() == len && memcmp(d.data(), buf, len) == 0) break;
+        }
+        if (j == end) {
+            ++_rep.mismatched;
+        } else {
+            _rep.lost += j - _matchPos;
+            _rep.latencyNs.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - _sentAt[j]).count());
+            ++_rep.received;
+            _rep.bytes += len;
+            _matchPos = j + 1;
+            _lastRecv = now;
+        }
+    }
+    _cv.notify_all();
+    return static_cast<ssize_t>(len);
+}
+
+ReplayReport ReplaySource::report() {
+    std::lock_guard<std::mutex> lk(_mu);
+    ReplayReport r = _rep;
+    r.lost += _next - _matchPos;
+    if (r.received)
+        r.elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(_lastRecv - _start).count();
+    return r;
+}
+
+}
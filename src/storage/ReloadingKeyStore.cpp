@@ -0,0 +1,281 @@
+#include "storage/ReloadingKeyStore.h"
+#include <openssl/err.h>
+#include <openssl/pem.h>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace tls {
+
+// quiet period after the last inotify event: cert and key are usually
+// replaced one after the other, we want to see both before checking
+static const int kQuietMs = 200;
+
+static bool readFile(const std::string& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static X509* parseCert(const std::string& pem) {
+    BIO* bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+    X509* x = bio ? PEM_read_bio_X509(bio, nullptr, nullptr, nullptr) : nullptr;
+    BIO_free(bio);
+    return x;
+}
+
+static EVP_PKEY* parseKey(const std::string& pem) {
+    BIO* bio = BIO_new_mem_buf(pem.data(), static_cast<int>(pem.size()));
+    EVP_PKEY* k = bio ? PEM_read_bio_PrivateKey(bio, nullptr, nullptr, nullptr) : nullptr;
+    BIO_free(bio);
+    return k;
+}
+
+static std::vector<uint8_t> certDer(X509* x) {
+    unsigned char* p = nullptr;
+    int n = i2d_X509(x, &p);
+    std::vector<uint8_t> der;
+    if (n > 0) der.assign(p, p + n);
+    OPENSSL_free(p);
+    return der;
+}
+
+static std::vector<uint8_t> keyDer(EVP_PKEY* k) {
+    unsigned char* p = nullptr;
+    int n = i2d_PrivateKey(k, &p);
+    std::vector<uint8_t> der;
+    if (n > 0) der.assign(p, p + n);
+    OPENSSL_free(p);
+    return der;
+}
+
+static std::string dirOf(const std::string& path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) return ".";
+    if (slash == 0) return "/";
+    return path.substr(0, slash);
+}
+
+ReloadingKeyStore::Material::~Material() {
+    if (cert) X509_free(cert);
+    if (key)  EVP_PKEY_free(key);
+}
+
+ReloadingKeyStore::~ReloadingKeyStore() {
+    if (_watcher.joinable()) {
+        uint64_t one = 1;
+        if (write(_stopFd, &one, sizeof(one)) != sizeof(one)) perror("[keystore] write(eventfd)");
+        _watcher.join();
+    }
+    if (_inotifyFd >= 0) close(_inotifyFd);
+    if (_stopFd >= 0) close(_stopFd);
+}
+
+std::shared_ptr<ReloadingKeyStore::Material> ReloadingKeyStore::current() const {
+    std::lock_guard<std::mutex> lk(_mu);
+    return _material;
+}
+
+bool ReloadingKeyStore::loadCertificate(SSL_CTX* ctx, const std::string& certFile) {
+    std::shared_ptr<Material> m = current();
+    bool samePath;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        samePath = certFile == _certFile;
+    }
+    if (!m || !m->cert || !samePath) {
+        std::shared_ptr<Material> next = std::make_shared<Material>();
+        if (!readFile(certFile, next->certPem)) {
+            fprintf(stderr, "[keystore] cannot read %s\n", certFile.c_str());
+            return false;
+        }
+        next->cert = parseCert(next->certPem);
+        if (!next->cert) { ERR_print_errors_fp(stderr); return false; }
+        next->certDer = certDer(next->cert);
+        if (m && m->key) {
+            EVP_PKEY_up_ref(m->key);
+            next->key = m->key;
+            next->keyPem = m->keyPem;
+            next->keyDer = m->keyDer;
+        }
+        {
+            std::lock_guard<std::mutex> lk(_mu);
+            _certFile = certFile;
+            _material = next;
+        }
+        m = next;
+    }
+
+    if (SSL_CTX_use_certificate(ctx, m->cert) != 1) {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+    startWatcher();
+    return true;
+}
+
+bool ReloadingKeyStore::loadPrivateKey(SSL_CTX* ctx, const std::string& keyFile) {
+    std::shared_ptr<Material> m = current();
+    bool samePath;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        samePath = keyFile == _keyFile;
+    }
+    if (!m || !m->key || !samePath) {
+        std::shared_ptr<Material> next = std::make_shared<Material>();
+        if (!readFile(keyFile, next->keyPem)) {
+            fprintf(stderr, "[keystore] cannot read %s\n", keyFile.c_str());
+            return false;
+        }
+        next->key = parseKey(next->keyPem);
+        if (!next->key) { ERR_print_errors_fp(stderr); return false; }
+        next->keyDer = keyDer(next->key);
+        if (m && m->cert) {
+            X509_up_ref(m->cert);
+            next->cert = m->cert;
+            next->certPem = m->certPem;
+            next->certDer = m->certDer;
+        }
+        {
+            std::lock_guard<std::mutex> lk(_mu);
+            _keyFile = keyFile;
+            _material = next;
+        }
+        m = next;
+    }
+
+    if (SSL_CTX_use_PrivateKey(ctx, m->key) != 1) {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+    startWatcher();
+    return true;
+}
+
+bool ReloadingKeyStore::loadKeyPair(SSL_CTX* ctx, const std::string& certFile, const std::string& keyFile) {
+    std::shared_ptr<Material> m = current();
+    bool samePaths;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        samePaths = certFile == _certFile && keyFile == _keyFile;
+    }
+    if (!m || !m->cert || !m->key || !samePaths) {
+        // first load: the single-file paths parse both and start the watcher
+        if (!loadCertificate(ctx, certFile) || !loadPrivateKey(ctx, keyFile)) return false;
+        m = current();
+    }
+
+    // one snapshot for both: a reload between two current() calls would
+    // otherwise pair the old certificate with the new key
+    if (SSL_CTX_use_certificate(ctx, m->cert) != 1 ||
+        SSL_CTX_use_PrivateKey(ctx, m->key) != 1) {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+    return true;
+}
+
+void ReloadingKeyStore::startWatcher() {
+    std::lock_guard<std::mutex> lk(_mu);
+    if (_watcher.joinable() || _certFile.empty() || _keyFile.empty()) return;
+
+    _inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (_inotifyFd < 0) { perror("[keystore] inotify_init1"); return; }
+
+    // watch directories, not files: editors and secret managers replace
+    // files by rename, which drops a watch on the old inode
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_ATTRIB;
+    std::string certDir = dirOf(_certFile), keyDir = dirOf(_keyFile);
+    if (inotify_add_watch(_inotifyFd, certDir.c_str(), mask) < 0 ||
+        (keyDir != certDir && inotify_add_watch(_inotifyFd, keyDir.c_str(), mask) < 0)) {
+        perror("[keystore] inotify_add_watch");
+        close(_inotifyFd); _inotifyFd = -1;
+        return;
+    }
+
+    _stopFd = eventfd(0, EFD_CLOEXEC);
+    if (_stopFd < 0) {
+        perror("[keystore] eventfd");
+        close(_inotifyFd); _inotifyFd = -1;
+        return;
+    }
+
+    _watcher = std::thread(&ReloadingKeyStore::watchLoop, this);
+    printf("[keystore] watching %s and %s\n", _certFile.c_str(), _keyFile.c_str());
+}
+
+void ReloadingKeyStore::watchLoop() {
+    char buf[4096];
+    pollfd fds[2] = {{_inotifyFd, POLLIN, 0}, {_stopFd, POLLIN, 0}};
+    bool pending = false;
+
+    for (;;) {
+        int r = poll(fds, 2, pending ? kQuietMs : -1);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("[keystore] poll");
+            return;
+        }
+        if (fds[1].revents & POLLIN) return;
+        if (r == 0) {
+            pending = false;
+            reload();
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            while (read(_inotifyFd, buf, sizeof(buf)) > 0) {}
+            pending = true;
+        }
+    }
+}
+
+void ReloadingKeyStore::reload() {
+    std::string certFile, keyFile;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        certFile = _certFile;
+        keyFile = _keyFile;
+    }
+    std::shared_ptr<Material> m = current();
+
+    std::shared_ptr<Material> next = std::make_shared<Material>();
+    if (!readFile(certFile, next->certPem) || !readFile(keyFile, next->keyPem))
+        return;                                   // mid-rotation, next event will retry
+    if (m && next->certPem == m->certPem && next->keyPem == m->keyPem)
+        return;                                   // touched, not changed
+
+    next->cert = parseCert(next->certPem);
+    next->key  = parseKey(next->keyPem);
+    if (!next->cert || !next->key) {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "[keystore] cannot parse new %s / %s, keeping current\n",
+                certFile.c_str(), keyFile.c_str());
+        return;
+    }
+    if (X509_check_private_key(next->cert, next->key) != 1) {
+        ERR_clear_error();
+        fprintf(stderr, "[keystore] new certificate and key do not match, keeping current\n");
+        return;
+    }
+    next->certDer = certDer(next->cert);
+    next->keyDer  = keyDer(next->key);
+
+    bool changed = !m || next->certDer != m->certDer || next->keyDer != m->keyDer;
+    {
+        std::lock_guard<std::mutex> lk(_mu);
+        _material = next;
+    }
+    if (!changed) return;                         // same material, reformatted PEM
+
+    uint64_t gen = ++_generation;
+    printf("[keystore] reloaded %s / %s (generation %llu)\n",
+           certFile.c_str(), keyFile.c_str(), static_cast<unsigned long long>(gen));
+}
+
+}
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# Regenerates the capture fixtures used by the tunnel_replay ctest entries.
+# Each file covers a different corner of PcapFile; the IP packet and
+# skipped-frame counts and the timestamp span printed here are the ones
+# CMakeLists.txt checks.
+#
+#   le_us_ethernet.pcap   little-endian, microseconds, Ethernet: 802.1Q and
+#                         QinQ tags, IPv6, padded short frame, ARP and a
+#                         snapped record (both skipped)
+#   be_ns_sll.pcap        big-endian, nanoseconds, Linux cooked (SLL)
+#   sections.pcapng       big-endian section (SLL2 at if_tsresol 10^-9, raw
+#                         IP at the default 10^-6) followed by a
+#                         little-endian section (raw IP at 2^-20), one
+#                         snapped enhanced packet block (skipped)
+#
+# Packets are 10 ms apart, so a misread timestamp unit shows up in the span.
+
+import os
+import struct
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+STEP_NS = 10 * 1000 * 1000
+
+
+def ipv4(i, payload_len, src=(10, 8, 0, 2), dst=(10, 8, 0, 1)):
+    payload = bytes((i * 7 + k) & 0xff for k in range(payload_len))
+    udp = struct.pack('!HHHH', 1000 + i, 9000, 8 + len(payload), 0) + payload
+    hdr = struct.pack('!BBHHHBBH4s4s', 0x45, 0, 20 + len(udp), i, 0, 64, 17, 0,
+                      bytes(src), bytes(dst))
+    return hdr + udp
+
+
+def ipv6(i, payload_len):
+    payload = bytes((i * 3 + k) & 0xff for k in range(payload_len))
+    udp = struct.pack('!HHHH', 2000 + i, 9000, 8 + len(payload), 0) + payload
+    src = bytes([0xfd] + [0] * 14 + [2])
+    dst = bytes([0xfd] + [0] * 14 + [1])
+    return struct.pack('!IHBB', 0x60000000, len(udp), 17, 64) + src + dst + udp
+
+
+def ether(payload, ethertype, tags=()):
+    frame = b'\x02' * 6 + b'\x04' * 6
+    # TPID/TCI pairs sit between the MACs and the real EtherType
+    for tpid, vid in tags:
+        frame += struct.pack('!HH', tpid, vid)
+    frame += struct.pack('!H', ethertype) + payload
+    if len(frame) < 60:
+        frame += b'\x00' * (60 - len(frame))
+    return frame
+
+
+def sll(payload, proto=0x0800):
+    return struct.pack('!HHH8sH', 0, 1, 6, b'\x02' * 6 + b'\x00\x00', proto) + payload
+
+
+def sll2(payload, proto=0x0800):
+    return struct.pack('!HHIHBB8s', proto, 0, 1, 1, 0, 6, b'\x02' * 6 + b'\x00\x00') + payload
+
+
+def pcap(path, endian, nanos, linktype, records):
+    magic = 0xa1b23c4d if nanos else 0xa1b2c3d4
+    with open(path, 'wb') as f:
+        f.write(struct.pack(endian + 'IHHiIII', magic, 2, 4, 0, 0, 65535, linktype))
+        for ts_ns, data, orig in records:
+            sec, frac = divmod(ts_ns, 10 ** 9)
+            if not nanos:
+                frac //= 1000
+            f.write(struct.pack(endian + 'IIII', sec, frac, len(data), orig) + data)
+
+
+def block(endian, btype, body):
+    body += b'\x00' * ((4 - len(body) % 4) % 4)
+    total = len(body) + 12
+    return struct.pack(endian + 'II', btype, total) + body + struct.pack(endian + 'I', total)
+
+
+def shb(endian):
+    return block(endian, 0x0a0d0d0a, struct.pack(endian + 'IHHq', 0x1a2b3c4d, 1, 0, -1))
+
+
+def idb(endian, linktype, tsresol=None):
+    body = struct.pack(endian + 'HHI', linktype, 0, 65535)
+    if tsresol is not None:
+        body += struct.pack(endian + 'HHB3x', 9, 1, tsresol)
+        body += struct.pack(endian + 'HH', 0, 0)
+    return block(endian, 1, body)
+
+
+def epb(endian, iface, ts_units, data, orig=None):
+    orig = len(data) if orig is None else orig
+    body = struct.pack(endian + 'IIIII', iface, ts_units >> 32, ts_units & 0xffffffff,
+                       len(data), orig) + data
+    return block(endian, 6, body)
+
+
+def main():
+    t0 = 1700000000 * 10 ** 9
+    ts = lambda i: t0 + i * STEP_NS
+    counts = {}
+
+    # --- little-endian, microseconds, Ethernet
+    recs = [
+        (ts(0), ether(ipv4(0, 100), 0x0800), None),
+        (ts(1), ether(ipv4(1, 4), 0x0800), None),                           # padded to 60
+        (ts(2), ether(ipv4(2, 300), 0x0800, [(0x8100, 10)]), None),          # 802.1Q
+        (ts(3), ether(ipv4(3, 200), 0x0800, [(0x88a8, 20), (0x8100, 30)]), None),  # QinQ
+        (ts(4), ether(ipv6(4, 120), 0x86dd), None),
+        (ts(5), ether(b'\x00' * 28, 0x0806), None),                           # ARP, skipped
+        (ts(6), ether(ipv4(6, 1400), 0x0800)[:200], 1442),                    # snapped, skipped
+        (ts(7), ether(ipv4(7, 1200), 0x0800), None),
+    ]
+    pcap(os.path.join(HERE, 'le_us_ethernet.pcap'), '<', False, 1,
+         [(t, d, len(d) if o is None else o) for t, d, o in recs])
+    counts['le_us_ethernet.pcap'] = (6, 2, 70)
+
+    # --- big-endian, nanoseconds, Linux cooked
+    recs = [(ts(i), sll(ipv4(i, 50 + 150 * i)), None) for i in range(5)]
+    recs.append((ts(5), sll(ipv6(5, 64), 0x86dd), None))
+    pcap(os.path.join(HERE, 'be_ns_sll.pcap'), '>', True, 113,
+         [(t, d, len(d) if o is None else o) for t, d, o in recs])
+    counts['be_ns_sll.pcap'] = (6, 0, 50)
+
+    # --- pcapng: big-endian section then little-endian section
+    out = shb('>')
+    out += idb('>', 276, tsresol=9)              # SLL2, ns
+    out += idb('>', 101)                         # raw IP, default us
+    out += epb('>', 0, ts(0), sll2(ipv4(0, 80)))
+    out += epb('>', 1, ts(1) // 1000, ipv4(1, 500))
+    out += epb('>', 0, ts(2), sll2(ipv6(2, 40), 0x86dd))
+    out += epb('>', 1, ts(3) // 1000, ipv4(3, 900)[:100], orig=948)    # snapped, skipped
+    out += shb('<')
+    out += idb('<', 101, tsresol=0x94)           # raw IP, 2^-20 s
+    for i in range(4, 7):
+        units = ts(i) * (1 << 20) // 10 ** 9
+        out += epb('<', 0, units, ipv4(i, 60 * i))
+    with open(os.path.join(HERE, 'sections.pcapng'), 'wb') as f:
+        f.write(out)
+    counts['sections.pcapng'] = (6, 1, 60)
+
+    for name, (packets, skipped, span_ms) in sorted(counts.items()):
+        print('%s: %d IP packets, %d skipped, %d ms span' % (name, packets, skipped, span_ms))
+
+
+if __name__ == '__main__':
+    main()